@@ -0,0 +1,15 @@
+#ifndef __LIBULTRA_GDB_BENCH_H
+#define __LIBULTRA_GDB_BENCH_H
+
+#include <time.h>
+
+static inline double benchNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// keeps the compiler from optimizing away the work being measured
+static volatile unsigned benchSink;
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "dispatch.h"
+
+#define ITERATIONS  2000000
+
+// the handlers dispatch.c looks up are defined here instead of in debugger.c
+#define BENCH_HANDLER(name, handler) \
+    enum GDBError handler(char* commandStart, char* packetEnd) { return GDBErrorNone; }
+
+GDB_NAMED_PACKETS(BENCH_HANDLER)
+
+#define GDB_PACKET_COMMAND(name, handler) {name, handler},
+
+static const struct GDBPacketCommand gdbSetPackets[] = {
+    GDB_SET_PACKETS(GDB_PACKET_COMMAND)
+};
+
+static const struct GDBPacketCommand gdbQueryPackets[] = {
+    GDB_QUERY_PACKETS(GDB_PACKET_COMMAND)
+};
+
+static const struct GDBPacketCommand gdbVPackets[] = {
+    GDB_V_PACKETS(GDB_PACKET_COMMAND)
+};
+
+static const struct GDBPacketCommand gdbHotPackets[] = {
+    GDB_HOT_PACKETS(GDB_PACKET_COMMAND)
+};
+
+#define PACKET_COUNT(commands)  (sizeof(commands) / sizeof(*(commands)))
+
+#define strStartsWith(str, constStr) (strncmp(str, constStr, sizeof constStr - 1) == 0)
+
+/**
+ * The if chain gdbHandleQuery and gdbHandleV used before the table,
+ * extended with every packet added since so both cover the same packets.
+ * Kept out of line so it pays for a call like gdbFindNamedPacketHandler
+ */
+static __attribute__((noinline)) int legacyDispatch(char* commandStart) {
+    if (*commandStart == 'q') {
+        if (strStartsWith(commandStart, "qSupported")) return 1;
+        else if (strStartsWith(commandStart, "qTStatus")) return 2;
+        else if (strStartsWith(commandStart, "qfThreadInfo")) return 3;
+        else if (strStartsWith(commandStart, "qsThreadInfo")) return 4;
+        else if (strStartsWith(commandStart, "qAttached")) return 5;
+        else if (strStartsWith(commandStart, "qC")) return 6;
+        else if (strStartsWith(commandStart, "qTfV")) return 7;
+        else if (strStartsWith(commandStart, "qTfP")) return 8;
+        else if (strStartsWith(commandStart, "qOffsets")) return 9;
+        else if (strStartsWith(commandStart, "qSymbol")) return 10;
+        else if (strStartsWith(commandStart, "qThreadExtraInfo")) return 11;
+        else if (strStartsWith(commandStart, "qXfer")) return 12;
+        else if (strStartsWith(commandStart, "qN64BreakHits")) return 13;
+        else if (strStartsWith(commandStart, "qTBuffer")) return 14;
+        else if (strStartsWith(commandStart, "qTsP")) return 15;
+        else if (strStartsWith(commandStart, "qTsV")) return 16;
+    } else if (*commandStart == 'Q') {
+        if (strStartsWith(commandStart, "QN64BreakIgnore")) return 17;
+        else if (strStartsWith(commandStart, "QTinit")) return 18;
+        else if (strStartsWith(commandStart, "QTDP")) return 19;
+        else if (strStartsWith(commandStart, "QTStart")) return 20;
+        else if (strStartsWith(commandStart, "QTStop")) return 21;
+        else if (strStartsWith(commandStart, "QTFrame")) return 22;
+        else if (strStartsWith(commandStart, "QTBuffer")) return 23;
+        else if (strStartsWith(commandStart, "QNonStop")) return 24;
+        else if (strStartsWith(commandStart, "QN64Profile")) return 25;
+        else if (strStartsWith(commandStart, "QN64Zones")) return 26;
+    } else if (*commandStart == 'v') {
+        if (strStartsWith(commandStart, "vMustReplyEmpty")) return 27;
+        else if (strStartsWith(commandStart, "vCont")) return 28;
+        else if (strStartsWith(commandStart, "vKill")) return 29;
+        else if (strStartsWith(commandStart, "vStopped")) return 30;
+    }
+    return 0;
+}
+
+/**
+ * @returns non zero if the list is sorted and each name finds its own handler
+ */
+static int checkPackets(const struct GDBPacketCommand* commands, int count) {
+    int i;
+
+    for (i = 1; i < count; ++i) {
+        if (strcmp(commands[i - 1].name, commands[i].name) >= 0) {
+            printf("GDB_NAMED_PACKETS is not sorted at %s\n", commands[i].name);
+            return 0;
+        }
+
+        if (commands[i].name[0] != commands[0].name[0]) {
+            printf("%s is in the list for another letter\n", commands[i].name);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < count; ++i) {
+        char* name = (char*)commands[i].name;
+        if (gdbFindNamedPacketHandler(name, name + strlen(name)) != commands[i].handler) {
+            printf("%s doesn't dispatch to its own handler\n", name);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @returns non zero if each hot packet has the handler from its list
+ */
+static int checkHotPackets() {
+    static const struct GDBPacketCommand namedPackets[] = {
+        GDB_NAMED_PACKETS(GDB_PACKET_COMMAND)
+    };
+    int i;
+    int j;
+
+    for (i = 0; i < PACKET_COUNT(gdbHotPackets); ++i) {
+        for (j = 0; j < PACKET_COUNT(namedPackets); ++j) {
+            if (strcmp(gdbHotPackets[i].name, namedPackets[j].name) == 0) {
+                break;
+            }
+        }
+
+        if (j == PACKET_COUNT(namedPackets) || namedPackets[j].handler != gdbHotPackets[i].handler) {
+            printf("hot packet %s doesn't match GDB_NAMED_PACKETS\n", gdbHotPackets[i].name);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static char* samplePackets[] = {
+    "vCont;c:1",
+    "vCont?",
+    "qfThreadInfo",
+    "qsThreadInfo",
+    "qC",
+    "qAttached",
+    "qThreadExtraInfo,3",
+    "qSupported:multiprocess+;swbreak+;hwbreak+;qRelocInsn+",
+    "qSymbol::",
+    "qOffsets",
+    "vKill;1",
+    "qTStatus",
+    "qXfer:features:read:target.xml:0,fff",
+    "qTsP",
+    "QTDP:1:80001000:1:0-",
+    "QNonStop:1",
+    "vStopped",
+};
+
+#define SAMPLE_COUNT    (sizeof(samplePackets) / sizeof(*samplePackets))
+
+int main() {
+    int i;
+
+    if (!checkPackets(gdbSetPackets, PACKET_COUNT(gdbSetPackets)) ||
+        !checkPackets(gdbQueryPackets, PACKET_COUNT(gdbQueryPackets)) ||
+        !checkPackets(gdbVPackets, PACKET_COUNT(gdbVPackets)) ||
+        !checkHotPackets()) {
+        return 1;
+    }
+
+    printf("%-40s %10s %10s\n", "packet", "table ns", "chain ns");
+
+    for (i = 0; i < SAMPLE_COUNT; ++i) {
+        char* packet = samplePackets[i];
+        char* packetEnd = packet + strlen(packet);
+        int iteration;
+
+        double start = benchNow();
+        for (iteration = 0; iteration < ITERATIONS; ++iteration) {
+            benchSink += gdbFindNamedPacketHandler(packet, packetEnd) != NULL;
+        }
+        double tableTime = benchNow() - start;
+
+        start = benchNow();
+        for (iteration = 0; iteration < ITERATIONS; ++iteration) {
+            benchSink += legacyDispatch(packet);
+        }
+        double chainTime = benchNow() - start;
+
+        printf("%-40.40s %10.2f %10.2f\n", packet, tableTime * 1e9 / ITERATIONS, chainTime * 1e9 / ITERATIONS);
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "hex.h"
+
+#define BUFFER_SIZE     0x10000
+#define ITERATIONS      400
+
+/**
+ * The nibble at a time versions debugger.c used before the tables
+ */
+static int legacyReadHexDigit(char character) {
+    if (character >= 'a' && character <= 'f') {
+        return 10 + character - 'a';
+    } else if (character >= 'A' && character <= 'F') {
+        return 10 + character - 'A';
+    } else if (character >= '0' && character <= '9') {
+        return character - '0';
+    } else {
+        return -1;
+    }   
+}
+
+static u32 legacyParseHex(char* src, u32 maxBytes) {
+    u32 result = 0;
+    int currentChar;
+    u32 maxCharacters = maxBytes * 2;
+
+    for (currentChar = 0; currentChar < maxCharacters; ++currentChar) {
+        int digit = legacyReadHexDigit(*src);
+
+        if (digit != -1) {
+            result = (result << 4) + digit;
+        } else {
+            break;
+        }
+
+        ++src;
+    }
+
+    return result;
+}
+
+static char legacyHexLetters[16] = "0123456789abcdef";
+
+static char* legacyWriteHex(char* target, u8* src, u32 bytes) {
+    u32 i;
+    for (i = 0; i < bytes; ++i) {
+        *target++ = legacyHexLetters[(*src) >> 4];
+        *target++ = legacyHexLetters[(*src) & 0xF];
+        ++src;
+    }
+    return target;
+}
+
+static char* legacyReadHex(u8* target, char* src, u32 maxBytes) {
+    u32 i;
+    for (i = 0; i < maxBytes; ++i) {
+        int firstDigit = legacyReadHexDigit(*src++);
+
+        if (firstDigit == -1) {
+            return src;
+        } else {
+            int secondDigit = legacyReadHexDigit(*src++);
+
+            if (secondDigit == -1) {
+                *target++ = firstDigit << 4;
+                return src;
+            } else {
+                *target++ = (firstDigit << 4) | secondDigit;
+            }
+        }
+    }
+    return src;
+}
+
+static u8 bytes[BUFFER_SIZE];
+static u8 decoded[BUFFER_SIZE];
+static u8 legacyDecoded[BUFFER_SIZE];
+static char hex[BUFFER_SIZE * 2 + 4];
+static char legacyHex[BUFFER_SIZE * 2 + 4];
+
+static int checkAgainstLegacy() {
+    static char* samples[] = {"80001234", "1a,40", "FfEe", "12345678abcd#00", "", "g", "0", "-1", "7fffffff"};
+    int i;
+
+    for (i = 0; i < sizeof(samples) / sizeof(*samples); ++i) {
+        char sample[32] = {0};
+        strcpy(sample, samples[i]);
+        u8 target[8] = {0};
+        u8 legacyTarget[8] = {0};
+
+        if (gdbParseHex(sample, 4) != legacyParseHex(sample, 4) ||
+            gdbReadHex(target, sample, 6) - sample != legacyReadHex(legacyTarget, sample, 6) - sample ||
+            memcmp(target, legacyTarget, sizeof(target)) != 0) {
+            printf("mismatch decoding '%s'\n", samples[i]);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < 256; ++i) {
+        if (gdbReadHexDigit(i) != legacyReadHexDigit(i)) {
+            printf("mismatch decoding digit %d\n", i);
+            return 0;
+        }
+    }
+
+    gdbWriteHex(hex, bytes, BUFFER_SIZE);
+    legacyWriteHex(legacyHex, bytes, BUFFER_SIZE);
+    gdbReadHex(decoded, hex, BUFFER_SIZE);
+
+    if (memcmp(hex, legacyHex, BUFFER_SIZE * 2) != 0 || memcmp(decoded, bytes, BUFFER_SIZE) != 0) {
+        printf("mismatch encoding buffer\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static void report(const char* name, double seconds, double legacySeconds) {
+    double megabytes = (double)BUFFER_SIZE * ITERATIONS / (1024 * 1024);
+    printf("%-8s %10.1f %11.1f %8.2fx\n", name, megabytes / seconds, megabytes / legacySeconds, legacySeconds / seconds);
+}
+
+int main() {
+    int i;
+    u32 seed = 1;
+
+    for (i = 0; i < BUFFER_SIZE; ++i) {
+        seed = seed * 1103515245 + 12345;
+        bytes[i] = seed >> 16;
+    }
+
+    if (!checkAgainstLegacy()) {
+        return 1;
+    }
+
+    double start = benchNow();
+    for (i = 0; i < ITERATIONS; ++i) {
+        benchSink += *gdbWriteHex(hex, bytes, BUFFER_SIZE);
+    }
+    double encodeTime = benchNow() - start;
+
+    start = benchNow();
+    for (i = 0; i < ITERATIONS; ++i) {
+        benchSink += *legacyWriteHex(legacyHex, bytes, BUFFER_SIZE);
+    }
+    double legacyEncodeTime = benchNow() - start;
+
+    start = benchNow();
+    for (i = 0; i < ITERATIONS; ++i) {
+        benchSink += *gdbReadHex(decoded, hex, BUFFER_SIZE);
+    }
+    double decodeTime = benchNow() - start;
+
+    start = benchNow();
+    for (i = 0; i < ITERATIONS; ++i) {
+        benchSink += *legacyReadHex(legacyDecoded, hex, BUFFER_SIZE);
+    }
+    double legacyDecodeTime = benchNow() - start;
+
+    printf("%-8s %10s %11s %9s\n", "", "table MB/s", "legacy MB/s", "speedup");
+    report("encode", encodeTime, legacyEncodeTime);
+    report("decode", decodeTime, legacyDecodeTime);
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef __LIBULTRA_GDB_BENCH_ULTRA64_H
+#define __LIBULTRA_GDB_BENCH_ULTRA64_H
+
+/**
+ * Just enough of libultra's types for the debugger files that don't
+ * touch the hardware to be compiled into the host benchmarks
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef struct OSPiHandle_s OSPiHandle;
+typedef struct OSMesgQueue_s OSMesgQueue;
+
+#endif
@@ -0,0 +1,728 @@
+#include "agent.h"
+#include "debugger.h"
+#include "registers.h"
+#include "hex.h"
+#include <string.h>
+
+// bytecodes from gdb's agent expression documentation
+#define GDB_AX_ADD              0x02
+#define GDB_AX_SUB              0x03
+#define GDB_AX_MUL              0x04
+#define GDB_AX_DIV_SIGNED       0x05
+#define GDB_AX_DIV_UNSIGNED     0x06
+#define GDB_AX_REM_SIGNED       0x07
+#define GDB_AX_REM_UNSIGNED     0x08
+#define GDB_AX_LSH              0x09
+#define GDB_AX_RSH_SIGNED       0x0a
+#define GDB_AX_RSH_UNSIGNED     0x0b
+#define GDB_AX_TRACE            0x0c
+#define GDB_AX_TRACE_QUICK      0x0d
+#define GDB_AX_LOG_NOT          0x0e
+#define GDB_AX_BIT_AND          0x0f
+#define GDB_AX_BIT_OR           0x10
+#define GDB_AX_BIT_XOR          0x11
+#define GDB_AX_BIT_NOT          0x12
+#define GDB_AX_EQUAL            0x13
+#define GDB_AX_LESS_SIGNED      0x14
+#define GDB_AX_LESS_UNSIGNED    0x15
+#define GDB_AX_EXT              0x16
+#define GDB_AX_REF8             0x17
+#define GDB_AX_REF16            0x18
+#define GDB_AX_REF32            0x19
+#define GDB_AX_REF64            0x1a
+#define GDB_AX_IF_GOTO          0x20
+#define GDB_AX_GOTO             0x21
+#define GDB_AX_CONST8           0x22
+#define GDB_AX_CONST16          0x23
+#define GDB_AX_CONST32          0x24
+#define GDB_AX_CONST64          0x25
+#define GDB_AX_REG              0x26
+#define GDB_AX_END              0x27
+#define GDB_AX_DUP              0x28
+#define GDB_AX_POP              0x29
+#define GDB_AX_ZERO_EXT         0x2a
+#define GDB_AX_SWAP             0x2b
+#define GDB_AX_TRACE16          0x30
+#define GDB_AX_PICK             0x32
+#define GDB_AX_ROT              0x33
+#define GDB_AX_PRINTF           0x34
+
+struct GDBExpressionList {
+    // 0 when the list isn't in use
+    u32 addr;
+    u16 length;
+    // each expression is a 2 byte length followed by its bytecode
+    u8 data[GDB_EXPRESSIONS_SIZE];
+};
+
+static struct GDBExpressionList gdbConditions[GDB_MAX_CONDITIONS];
+static struct GDBExpressionList gdbCommands[GDB_MAX_COMMANDS];
+// a Z0 is parsed here first so a bad packet leaves the breakpoint as it was
+static struct GDBExpressionList gdbParsedConditions;
+static struct GDBExpressionList gdbParsedCommands;
+
+static char gdbPrintfBuffer[GDB_AGENT_PRINTF_SIZE];
+
+/**
+ * Writes prefix then digits padded out to width
+ */
+static char* gdbPrintfPad(char* target, char* end, const char* prefix, const char* digits, int width, int zeroPad, int leftAlign) {
+    int length = strlen(prefix) + strlen(digits);
+    int padding = width > length ? width - length : 0;
+
+    if (!leftAlign && !zeroPad) {
+        while (padding > 0 && target < end) {
+            *target++ = ' ';
+            --padding;
+        }
+    }
+
+    while (*prefix && target < end) {
+        *target++ = *prefix++;
+    }
+
+    if (zeroPad && !leftAlign) {
+        while (padding > 0 && target < end) {
+            *target++ = '0';
+            --padding;
+        }
+    }
+
+    while (*digits && target < end) {
+        *target++ = *digits++;
+    }
+
+    while (padding > 0 && target < end) {
+        *target++ = ' ';
+        --padding;
+    }
+
+    return target;
+}
+
+/**
+ * Formats a dprintf message and sends it as text. Supports the
+ * integer, character, pointer and string conversions with flags, 
+ * width and the h, l and z size modifiers
+ * @param args the arguments with the last argument first, the 
+ *  order they are on the agent stack
+ */
+static void gdbAgentPrintf(const char* format, const s64* args, int argCount) {
+    char* target = gdbPrintfBuffer;
+    char* end = gdbPrintfBuffer + GDB_AGENT_PRINTF_SIZE;
+
+    while (*format && target < end) {
+        if (*format != '%') {
+            *target++ = *format++;
+            continue;
+        }
+
+        ++format;
+
+        int leftAlign = 0;
+        int zeroPad = 0;
+        int width = 0;
+        // negative for h, positive for l
+        int size = 0;
+
+        while (*format == '-' || *format == '0' || *format == '+' || *format == ' ' || *format == '#') {
+            leftAlign |= *format == '-';
+            zeroPad |= *format == '0';
+            ++format;
+        }
+
+        while (*format >= '0' && *format <= '9') {
+            width = width * 10 + *format - '0';
+            ++format;
+        }
+
+        if (*format == '.') {
+            // precision isn't supported
+            ++format;
+            while (*format >= '0' && *format <= '9') {
+                ++format;
+            }
+        }
+
+        while (*format == 'h' || *format == 'l' || *format == 'z' || *format == 'j' || *format == 't') {
+            size += *format == 'h' ? -1 : (*format == 'l' ? 1 : 0);
+            ++format;
+        }
+
+        char conversion = *format;
+
+        if (conversion == '%') {
+            *target++ = '%';
+            ++format;
+            continue;
+        } else if (!conversion || argCount == 0) {
+            break;
+        }
+
+        ++format;
+        --argCount;
+        u64 value = args[argCount];
+        char digits[24];
+        char* digit = &digits[sizeof(digits) - 1];
+        const char* prefix = "";
+        int base = 10;
+        const char* digitChars = "0123456789abcdef";
+        *digit = '\0';
+
+        // long is 32 bits on the N64
+        if (size <= -2) {
+            value = conversion == 'd' || conversion == 'i' ? (s64)(s8)value : (u8)value;
+        } else if (size == -1) {
+            value = conversion == 'd' || conversion == 'i' ? (s64)(s16)value : (u16)value;
+        } else if (size < 2) {
+            value = conversion == 'd' || conversion == 'i' ? (s64)(s32)value : (u32)value;
+        }
+
+        switch (conversion) {
+            case 'c':
+                digits[0] = (char)value;
+                digits[1] = '\0';
+                target = gdbPrintfPad(target, end, "", digits, width, 0, leftAlign);
+                continue;
+            case 's':
+            {
+                char* src = gdbTranslateAddr((void*)(u32)value);
+                u32 length = gdbReadableLength(src, end - target);
+                u32 start = target - gdbPrintfBuffer;
+
+                if (!src) {
+                    target = gdbPrintfPad(target, end, "", "(null)", width, 0, leftAlign);
+                    continue;
+                }
+
+                while (length > 0 && *src && target < end) {
+                    *target++ = *src++;
+                    --length;
+                }
+
+                // pad after the fact since the length wasn't known
+                while (target - gdbPrintfBuffer - start < width && target < end) {
+                    *target++ = ' ';
+                }
+                continue;
+            }
+            case 'd':
+            case 'i':
+                if ((s64)value < 0) {
+                    prefix = "-";
+                    value = -(s64)value;
+                }
+                break;
+            case 'o':
+                base = 8;
+                break;
+            case 'p':
+                prefix = "0x";
+                value = (u32)value;
+                base = 16;
+                break;
+            case 'X':
+                digitChars = "0123456789ABCDEF";
+                // fall through
+            case 'x':
+                base = 16;
+                break;
+            case 'u':
+                break;
+            default:
+                // floating point isn't supported
+                prefix = "?";
+                value = 0;
+                break;
+        }
+
+        do {
+            *--digit = digitChars[value % base];
+            value /= base;
+        } while (value);
+
+        target = gdbPrintfPad(target, end, prefix, digit, width, zeroPad, leftAlign);
+    }
+
+    gdbSendMessage(GDBDataTypeText, gdbPrintfBuffer, target - gdbPrintfBuffer);
+}
+
+static u64 gdbAgentReadBigEndian(const u8* src, int bytes) {
+    u64 result = 0;
+
+    while (bytes > 0) {
+        result = (result << 8) | *src++;
+        --bytes;
+    }
+
+    return result;
+}
+
+static enum GDBAgentResult gdbAgentReadMemory(u32 addr, int bytes, s64* result) {
+    u8* src = gdbTranslateAddr((void*)addr);
+
+    if (!src || gdbReadableLength(src, bytes) < bytes) {
+        return GDBAgentResultBadMemory;
+    }
+
+    *result = gdbAgentReadBigEndian(src, bytes);
+    return GDBAgentResultOK;
+}
+
+#define GDB_AGENT_POP(count)    if (top < (count)) return GDBAgentResultStackUnderflow
+#define GDB_AGENT_PUSH(count)   if (top + (count) > GDB_AGENT_STACK_SIZE) return GDBAgentResultStackOverflow
+#define GDB_AGENT_OPERAND(bytes) if (pc + (bytes) > length) return GDBAgentResultBadJump
+
+enum GDBAgentResult gdbAgentEval(const u8* bytecode, u32 length, OSThread* thread, GDBAgentTraceHandler trace, s64* result) {
+    s64 stack[GDB_AGENT_STACK_SIZE];
+    int top = 0;
+    u32 pc = 0;
+    int steps = 0;
+
+    while (pc < length) {
+        if (++steps > GDB_AGENT_MAX_STEPS) {
+            return GDBAgentResultTooManySteps;
+        }
+
+        u8 op = bytecode[pc++];
+        s64 a;
+        s64 b;
+
+        switch (op) {
+            case GDB_AX_ADD:
+            case GDB_AX_SUB:
+            case GDB_AX_MUL:
+            case GDB_AX_DIV_SIGNED:
+            case GDB_AX_DIV_UNSIGNED:
+            case GDB_AX_REM_SIGNED:
+            case GDB_AX_REM_UNSIGNED:
+            case GDB_AX_LSH:
+            case GDB_AX_RSH_SIGNED:
+            case GDB_AX_RSH_UNSIGNED:
+            case GDB_AX_BIT_AND:
+            case GDB_AX_BIT_OR:
+            case GDB_AX_BIT_XOR:
+            case GDB_AX_EQUAL:
+            case GDB_AX_LESS_SIGNED:
+            case GDB_AX_LESS_UNSIGNED:
+                GDB_AGENT_POP(2);
+                // a is the deeper value so a - b is sub
+                a = stack[top - 2];
+                b = stack[top - 1];
+                --top;
+
+                switch (op) {
+                    case GDB_AX_ADD: a = a + b; break;
+                    case GDB_AX_SUB: a = a - b; break;
+                    case GDB_AX_MUL: a = a * b; break;
+                    case GDB_AX_DIV_SIGNED:
+                    case GDB_AX_DIV_UNSIGNED:
+                    case GDB_AX_REM_SIGNED:
+                    case GDB_AX_REM_UNSIGNED:
+                        if (b == 0) {
+                            return GDBAgentResultDivideByZero;
+                        }
+
+                        if (op == GDB_AX_DIV_SIGNED) {
+                            a = a / b;
+                        } else if (op == GDB_AX_DIV_UNSIGNED) {
+                            a = (u64)a / (u64)b;
+                        } else if (op == GDB_AX_REM_SIGNED) {
+                            a = a % b;
+                        } else {
+                            a = (u64)a % (u64)b;
+                        }
+                        break;
+                    case GDB_AX_LSH: a = a << b; break;
+                    case GDB_AX_RSH_SIGNED: a = a >> b; break;
+                    case GDB_AX_RSH_UNSIGNED: a = (u64)a >> b; break;
+                    case GDB_AX_BIT_AND: a = a & b; break;
+                    case GDB_AX_BIT_OR: a = a | b; break;
+                    case GDB_AX_BIT_XOR: a = a ^ b; break;
+                    case GDB_AX_EQUAL: a = a == b; break;
+                    case GDB_AX_LESS_SIGNED: a = a < b; break;
+                    case GDB_AX_LESS_UNSIGNED: a = (u64)a < (u64)b; break;
+                }
+
+                stack[top - 1] = a;
+                break;
+            case GDB_AX_LOG_NOT:
+                GDB_AGENT_POP(1);
+                stack[top - 1] = !stack[top - 1];
+                break;
+            case GDB_AX_BIT_NOT:
+                GDB_AGENT_POP(1);
+                stack[top - 1] = ~stack[top - 1];
+                break;
+            case GDB_AX_EXT:
+            case GDB_AX_ZERO_EXT:
+            {
+                GDB_AGENT_OPERAND(1);
+                int bits = bytecode[pc++];
+                GDB_AGENT_POP(1);
+
+                if (bits > 0 && bits < 64) {
+                    if (op == GDB_AX_EXT) {
+                        stack[top - 1] = (stack[top - 1] << (64 - bits)) >> (64 - bits);
+                    } else {
+                        stack[top - 1] = (u64)stack[top - 1] & (((u64)1 << bits) - 1);
+                    }
+                }
+                break;
+            }
+            case GDB_AX_REF8:
+            case GDB_AX_REF16:
+            case GDB_AX_REF32:
+            case GDB_AX_REF64:
+            {
+                GDB_AGENT_POP(1);
+                enum GDBAgentResult readResult = gdbAgentReadMemory(
+                    (u32)stack[top - 1], 
+                    1 << (op - GDB_AX_REF8), 
+                    &stack[top - 1]
+                );
+
+                if (readResult != GDBAgentResultOK) {
+                    return readResult;
+                }
+                break;
+            }
+            case GDB_AX_IF_GOTO:
+            case GDB_AX_GOTO:
+            {
+                GDB_AGENT_OPERAND(2);
+                u32 target = (u32)gdbAgentReadBigEndian(&bytecode[pc], 2);
+                pc += 2;
+
+                if (op == GDB_AX_IF_GOTO) {
+                    GDB_AGENT_POP(1);
+                    --top;
+
+                    if (!stack[top]) {
+                        break;
+                    }
+                }
+
+                if (target >= length) {
+                    return GDBAgentResultBadJump;
+                }
+
+                pc = target;
+                break;
+            }
+            case GDB_AX_CONST8:
+            case GDB_AX_CONST16:
+            case GDB_AX_CONST32:
+            case GDB_AX_CONST64:
+            {
+                int bytes = 1 << (op - GDB_AX_CONST8);
+                GDB_AGENT_OPERAND(bytes);
+                GDB_AGENT_PUSH(1);
+                // constants are zero extended
+                stack[top++] = gdbAgentReadBigEndian(&bytecode[pc], bytes);
+                pc += bytes;
+                break;
+            }
+            case GDB_AX_REG:
+            {
+                GDB_AGENT_OPERAND(2);
+                int regNum = (int)gdbAgentReadBigEndian(&bytecode[pc], 2);
+                pc += 2;
+                GDB_AGENT_PUSH(1);
+
+                if (regNum >= GDB_REGISTER_COUNT) {
+                    return GDBAgentResultBadOpcode;
+                }
+
+                stack[top++] = gdbGetRegisterValue(thread, regNum);
+                break;
+            }
+            case GDB_AX_END:
+                *result = top > 0 ? stack[top - 1] : 0;
+                return GDBAgentResultOK;
+            case GDB_AX_DUP:
+                GDB_AGENT_POP(1);
+                GDB_AGENT_PUSH(1);
+                stack[top] = stack[top - 1];
+                ++top;
+                break;
+            case GDB_AX_POP:
+                GDB_AGENT_POP(1);
+                --top;
+                break;
+            case GDB_AX_SWAP:
+                GDB_AGENT_POP(2);
+                a = stack[top - 1];
+                stack[top - 1] = stack[top - 2];
+                stack[top - 2] = a;
+                break;
+            case GDB_AX_PICK:
+            {
+                GDB_AGENT_OPERAND(1);
+                int depth = bytecode[pc++];
+                GDB_AGENT_POP(depth + 1);
+                GDB_AGENT_PUSH(1);
+                stack[top] = stack[top - 1 - depth];
+                ++top;
+                break;
+            }
+            case GDB_AX_TRACE:
+            {
+                if (!trace) {
+                    return GDBAgentResultBadOpcode;
+                }
+
+                // addr size =>
+                GDB_AGENT_POP(2);
+                enum GDBAgentResult traceResult = trace((u32)stack[top - 2], (u32)stack[top - 1]);
+                top -= 2;
+
+                if (traceResult != GDBAgentResultOK) {
+                    return traceResult;
+                }
+                break;
+            }
+            case GDB_AX_TRACE_QUICK:
+            case GDB_AX_TRACE16:
+            {
+                int bytes = op == GDB_AX_TRACE16 ? 2 : 1;
+                GDB_AGENT_OPERAND(bytes);
+                u32 size = (u32)gdbAgentReadBigEndian(&bytecode[pc], bytes);
+                pc += bytes;
+
+                if (!trace) {
+                    return GDBAgentResultBadOpcode;
+                }
+
+                // addr => addr
+                GDB_AGENT_POP(1);
+                enum GDBAgentResult traceResult = trace((u32)stack[top - 1], size);
+
+                if (traceResult != GDBAgentResultOK) {
+                    return traceResult;
+                }
+                break;
+            }
+            case GDB_AX_ROT:
+                // a b c => c a b
+                GDB_AGENT_POP(3);
+                a = stack[top - 1];
+                stack[top - 1] = stack[top - 2];
+                stack[top - 2] = stack[top - 3];
+                stack[top - 3] = a;
+                break;
+            case GDB_AX_PRINTF:
+            {
+                GDB_AGENT_OPERAND(3);
+                int argCount = bytecode[pc];
+                u32 formatLength = (u32)gdbAgentReadBigEndian(&bytecode[pc + 1], 2);
+                const char* format = (const char*)&bytecode[pc + 3];
+                pc += 3;
+                GDB_AGENT_OPERAND(formatLength);
+                pc += formatLength;
+
+                if (!formatLength || format[formatLength - 1] != '\0') {
+                    return GDBAgentResultBadOpcode;
+                }
+
+                // the function and channel are on top of the arguments
+                GDB_AGENT_POP(2 + argCount);
+                top -= 2 + argCount;
+                gdbAgentPrintf(format, &stack[top], argCount);
+                break;
+            }
+            default:
+                // floating point and state variables aren't supported
+                return GDBAgentResultBadOpcode;
+        }
+    }
+
+    // ran off the end without an end instruction
+    return GDBAgentResultBadJump;
+}
+
+static struct GDBExpressionList* gdbFindExpressions(struct GDBExpressionList* lists, int count, u32 addr) {
+    int i;
+    for (i = 0; i < count; ++i) {
+        if (lists[i].addr == addr) {
+            return &lists[i];
+        }
+    }
+    return NULL;
+}
+
+static void gdbClearExpressions(struct GDBExpressionList* lists, int count, u32 addr) {
+    struct GDBExpressionList* expressions = gdbFindExpressions(lists, count, addr);
+
+    if (expressions) {
+        expressions->addr = 0;
+        expressions->length = 0;
+    }
+}
+
+/**
+ * Replaces the list for addr with parsed. An empty list only 
+ * removes the old one
+ */
+static void gdbStoreExpressions(struct GDBExpressionList* lists, int count, u32 addr, struct GDBExpressionList* parsed) {
+    struct GDBExpressionList* expressions = gdbFindExpressions(lists, count, addr);
+
+    if (!expressions && parsed->length) {
+        expressions = gdbFindExpressions(lists, count, 0);
+    }
+
+    if (!expressions) {
+        return;
+    }
+
+    if (parsed->length) {
+        *expressions = *parsed;
+        expressions->addr = addr;
+    } else {
+        expressions->addr = 0;
+        expressions->length = 0;
+    }
+}
+
+/**
+ * Checks if gdbStoreExpressions has room for the list
+ */
+static int gdbHasExpressionsRoom(struct GDBExpressionList* lists, int count, u32 addr, struct GDBExpressionList* parsed) {
+    return !parsed->length || gdbFindExpressions(lists, count, addr) || gdbFindExpressions(lists, count, 0);
+}
+
+/**
+ * Parses each "X len,expr" at src. gdb doesn't put anything 
+ * between expressions but a ';' before each one is accepted
+ */
+static enum GDBError gdbParseExpressions(struct GDBExpressionList* expressions, char* src, char* packetEnd) {
+    expressions->length = 0;
+
+    while (src < packetEnd) {
+        if (*src == ';' && src + 1 < packetEnd && src[1] == 'X') {
+            ++src;
+        } else if (*src != 'X') {
+            break;
+        }
+
+        u32 len = gdbParseHex(src + 1, 4);
+        char* expr = src + 1;
+
+        while (expr < packetEnd && *expr != ',') {
+            ++expr;
+        }
+
+        ++expr;
+
+        // checked before any math on len so it can't wrap
+        if (len > GDB_EXPRESSIONS_SIZE) {
+            return GDBErrorBufferTooSmall;
+        }
+
+        if (expr + len * 2 > packetEnd) {
+            return GDBErrorBadPacket;
+        }
+
+        if (expressions->length + 2 + len > GDB_EXPRESSIONS_SIZE) {
+            return GDBErrorBufferTooSmall;
+        }
+
+        u8* target = &expressions->data[expressions->length];
+        target[0] = (u8)(len >> 8);
+        target[1] = (u8)len;
+        gdbReadHex(target + 2, expr, len);
+        expressions->length += 2 + len;
+
+        src = expr + len * 2;
+    }
+
+    return GDBErrorNone;
+}
+
+void gdbClearConditions(u32 addr) {
+    gdbClearExpressions(gdbConditions, GDB_MAX_CONDITIONS, addr);
+}
+
+enum GDBError gdbParseConditions(char* src, char* packetEnd) {
+    gdbParsedConditions.length = 0;
+
+    if (src + 1 >= packetEnd || src[0] != ';' || src[1] != 'X') {
+        return GDBErrorNone;
+    }
+
+    return gdbParseExpressions(&gdbParsedConditions, src, packetEnd);
+}
+
+int gdbCheckConditions(u32 addr, OSThread* thread) {
+    struct GDBExpressionList* conditions = gdbFindExpressions(gdbConditions, GDB_MAX_CONDITIONS, addr);
+
+    if (!conditions) {
+        return 1;
+    }
+
+    u32 offset = 0;
+
+    while (offset < conditions->length) {
+        u32 len = (conditions->data[offset] << 8) | conditions->data[offset + 1];
+        s64 value;
+
+        if (gdbAgentEval(&conditions->data[offset + 2], len, thread, NULL, &value) != GDBAgentResultOK || value) {
+            return 1;
+        }
+
+        offset += 2 + len;
+    }
+
+    return 0;
+}
+
+void gdbClearCommands(u32 addr) {
+    gdbClearExpressions(gdbCommands, GDB_MAX_COMMANDS, addr);
+}
+
+enum GDBError gdbParseCommands(char* src, char* packetEnd) {
+    gdbParsedCommands.length = 0;
+
+    if (strncmp(src, ";cmds:", strlen(";cmds:")) != 0) {
+        return GDBErrorNone;
+    }
+
+    // the persist flag doesn't matter since commands are kept until z0
+    src += strlen(";cmds:");
+    while (src < packetEnd && *src != ',') {
+        ++src;
+    }
+
+    return gdbParseExpressions(&gdbParsedCommands, src + 1, packetEnd);
+}
+
+enum GDBError gdbStoreParsedExpressions(u32 addr) {
+    if (!gdbHasExpressionsRoom(gdbConditions, GDB_MAX_CONDITIONS, addr, &gdbParsedConditions) ||
+        !gdbHasExpressionsRoom(gdbCommands, GDB_MAX_COMMANDS, addr, &gdbParsedCommands)) {
+        return GDBErrorBufferTooSmall;
+    }
+
+    gdbStoreExpressions(gdbConditions, GDB_MAX_CONDITIONS, addr, &gdbParsedConditions);
+    gdbStoreExpressions(gdbCommands, GDB_MAX_COMMANDS, addr, &gdbParsedCommands);
+
+    return GDBErrorNone;
+}
+
+int gdbRunCommands(u32 addr, OSThread* thread) {
+    struct GDBExpressionList* commands = gdbFindExpressions(gdbCommands, GDB_MAX_COMMANDS, addr);
+
+    if (!commands) {
+        return 0;
+    }
+
+    u32 offset = 0;
+
+    while (offset < commands->length) {
+        u32 len = (commands->data[offset] << 8) | commands->data[offset + 1];
+        s64 value;
+        gdbAgentEval(&commands->data[offset + 2], len, thread, NULL, &value);
+        offset += 2 + len;
+    }
+
+    return 1;
+}
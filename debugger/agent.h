@@ -0,0 +1,77 @@
+#ifndef __LIBULTRA_GDB_AGENT_H
+#define __LIBULTRA_GDB_AGENT_H
+
+#include <ultra64.h>
+#include "serial.h"
+
+#define GDB_AGENT_STACK_SIZE    32
+// stops expressions that loop forever
+#define GDB_AGENT_MAX_STEPS     4096
+
+#define GDB_MAX_CONDITIONS      16
+#define GDB_MAX_COMMANDS        16
+// bytecode for all the conditions or commands of one breakpoint
+#define GDB_EXPRESSIONS_SIZE    256
+// the longest message printf sends
+#define GDB_AGENT_PRINTF_SIZE   256
+
+enum GDBAgentResult {
+    GDBAgentResultOK,
+    GDBAgentResultBadOpcode,
+    GDBAgentResultStackOverflow,
+    GDBAgentResultStackUnderflow,
+    GDBAgentResultBadMemory,
+    GDBAgentResultDivideByZero,
+    GDBAgentResultBadJump,
+    GDBAgentResultTooManySteps,
+};
+
+/**
+ * Called by the trace bytecodes to collect len bytes at addr
+ */
+typedef enum GDBAgentResult (*GDBAgentTraceHandler)(u32 addr, u32 len);
+
+/**
+ * Runs a gdb agent expression against a stopped thread
+ * @param trace collects memory for the trace bytecodes. Trace 
+ *  bytecodes are rejected when NULL
+ * @param result the value on the top of the stack when the expression ends
+ */
+enum GDBAgentResult gdbAgentEval(const u8* bytecode, u32 length, OSThread* thread, GDBAgentTraceHandler trace, s64* result);
+
+/**
+ * Parses the cond_list of a Z0 packet. Nothing changes until
+ * gdbStoreParsedExpressions
+ * @param src the text after the breakpoint kind. Conditions are 
+ *  parsed from each ";X len,expr" until anything else is reached
+ */
+enum GDBError gdbParseConditions(char* src, char* packetEnd);
+void gdbClearConditions(u32 addr);
+/**
+ * Returns non zero if the breakpoint at addr has no conditions or if
+ * any of its conditions are true. A condition that can't be evaluated 
+ * counts as true so the thread stops
+ */
+int gdbCheckConditions(u32 addr, OSThread* thread);
+
+/**
+ * Parses the cmd_list of a Z0 packet. Nothing changes until
+ * gdbStoreParsedExpressions
+ * @param src the ";cmds:persist," part of the packet or anything
+ *  else to clear the commands
+ */
+enum GDBError gdbParseCommands(char* src, char* packetEnd);
+void gdbClearCommands(u32 addr);
+/**
+ * Replaces the conditions and commands of the breakpoint at addr
+ * with the ones last parsed. Either both are replaced or neither
+ */
+enum GDBError gdbStoreParsedExpressions(u32 addr);
+/**
+ * Runs the commands of the breakpoint at addr. Returns 0 if the
+ * breakpoint has no commands. Breakpoints with commands are 
+ * dprintf breakpoints that never stop
+ */
+int gdbRunCommands(u32 addr, OSThread* thread);
+
+#endif
@@ -0,0 +1,286 @@
+#include "breakpoint.h"
+
+// kept at most half full so probe sequences stay short
+#define GDB_BREAKPOINT_TABLE_SIZE   (GDB_MAX_BREAK_POINTS * 2)
+#define GDB_BREAKPOINT_TABLE_MASK   (GDB_BREAKPOINT_TABLE_SIZE - 1)
+
+#define GDB_MAX_TEMPORARY_BREAKPOINTS   8
+
+static struct GDBBreakpoint gdbBreakpoints[GDB_BREAKPOINT_TABLE_SIZE];
+static u32 gdbBreakpointCount;
+// set when a breakpoint needs to be written to or restored from memory
+static int gdbBreakpointsDirty;
+
+/**
+ * A breakpoint placed to step a thread. Other threads that hit it
+ * are stepped over it without stopping
+ */
+struct GDBTemporaryBreakpoint {
+    u32 addr;
+    OSThread* owner;
+};
+
+static struct GDBTemporaryBreakpoint gdbTemporaryBreakpoints[GDB_MAX_TEMPORARY_BREAKPOINTS];
+static u32 gdbTemporaryBreakpointCount;
+
+static u32 gdbBreakpointSlot(u32 addr) {
+    u32 hash = (addr >> 2) * 0x9E3779B1u;
+    return (hash ^ (hash >> 16)) & GDB_BREAKPOINT_TABLE_MASK;
+}
+
+/**
+ * Finds the entry for addr including breakpoints waiting to be removed
+ */
+static struct GDBBreakpoint* gdbLookupBreakpoint(u32 addr) {
+    u32 slot = gdbBreakpointSlot(addr);
+
+    while (gdbBreakpoints[slot].addr) {
+        if (gdbBreakpoints[slot].addr == addr) {
+            return &gdbBreakpoints[slot];
+        }
+
+        slot = (slot + 1) & GDB_BREAKPOINT_TABLE_MASK;
+    }
+
+    return NULL;
+}
+
+/**
+ * Removes an entry from the table. Later entries in the same probe
+ * sequence are shifted back so lookups never need tombstones
+ */
+static void gdbDeleteBreakpoint(struct GDBBreakpoint* brk) {
+    u32 hole = brk - gdbBreakpoints;
+    u32 slot = (hole + 1) & GDB_BREAKPOINT_TABLE_MASK;
+
+    while (gdbBreakpoints[slot].addr) {
+        u32 home = gdbBreakpointSlot(gdbBreakpoints[slot].addr);
+
+        // an entry can only move back if the hole is between its home slot and where it is now
+        if (((slot - home) & GDB_BREAKPOINT_TABLE_MASK) >= ((slot - hole) & GDB_BREAKPOINT_TABLE_MASK)) {
+            gdbBreakpoints[hole] = gdbBreakpoints[slot];
+            hole = slot;
+        }
+
+        slot = (slot + 1) & GDB_BREAKPOINT_TABLE_MASK;
+    }
+
+    bzero(&gdbBreakpoints[hole], sizeof(struct GDBBreakpoint));
+    --gdbBreakpointCount;
+}
+
+struct GDBBreakpoint* gdbFindBreakpoint(u32 addr) {
+    struct GDBBreakpoint* result = gdbLookupBreakpoint(addr);
+
+    if (result && result->type != GDBBreakpointTypeNone) {
+        return result;
+    }
+
+    return NULL;
+}
+
+struct GDBBreakpoint* gdbInsertBreakPoint(u32 addr, enum GDBBreakpointType type) {
+    if (!addr) {
+        return NULL;
+    }
+
+    struct GDBBreakpoint* result = gdbLookupBreakpoint(addr);
+
+    if (!result) {
+        if (gdbBreakpointCount == GDB_MAX_BREAK_POINTS) {
+            return NULL;
+        }
+
+        u32 slot = gdbBreakpointSlot(addr);
+
+        while (gdbBreakpoints[slot].addr) {
+            slot = (slot + 1) & GDB_BREAKPOINT_TABLE_MASK;
+        }
+
+        result = &gdbBreakpoints[slot];
+        result->addr = addr;
+        ++gdbBreakpointCount;
+    }
+
+    // reinserting a breakpoint waiting to be removed cancels the 
+    // removal and keeps its hit and ignore counts
+    if (result->type < type) {
+        result->type = type;
+    }
+
+    if (!result->isApplied) {
+        gdbBreakpointsDirty = 1;
+    }
+
+    return result;
+}
+
+void gdbRemoveBreakpoint(struct GDBBreakpoint* brk) {
+    if (!brk) {
+        return;
+    }
+
+    if (brk->isApplied) {
+        brk->type = GDBBreakpointTypeNone;
+        gdbBreakpointsDirty = 1;
+    } else {
+        // the trap was never written so there is nothing to restore
+        gdbDeleteBreakpoint(brk);
+    }
+}
+
+int gdbIsTemporaryBreakpointOwner(u32 addr, OSThread* thread) {
+    u32 i;
+
+    for (i = 0; i < gdbTemporaryBreakpointCount; ++i) {
+        if (gdbTemporaryBreakpoints[i].addr == addr && (!thread || gdbTemporaryBreakpoints[i].owner == thread)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+struct GDBBreakpoint* gdbInsertTemporaryBreakpoint(u32 addr, OSThread* owner) {
+    if (!gdbIsTemporaryBreakpointOwner(addr, owner)) {
+        if (gdbTemporaryBreakpointCount == GDB_MAX_TEMPORARY_BREAKPOINTS) {
+            return NULL;
+        }
+
+        gdbTemporaryBreakpoints[gdbTemporaryBreakpointCount].addr = addr;
+        gdbTemporaryBreakpoints[gdbTemporaryBreakpointCount].owner = owner;
+        ++gdbTemporaryBreakpointCount;
+    }
+
+    return gdbInsertBreakPoint(addr, GDBBreakpointTypeTemporary);
+}
+
+void gdbRemoveTemporaryBreakpoints(OSThread* owner) {
+    u32 i = 0;
+
+    while (i < gdbTemporaryBreakpointCount) {
+        if (gdbTemporaryBreakpoints[i].owner != owner) {
+            ++i;
+            continue;
+        }
+
+        u32 addr = gdbTemporaryBreakpoints[i].addr;
+        gdbTemporaryBreakpoints[i] = gdbTemporaryBreakpoints[--gdbTemporaryBreakpointCount];
+
+        struct GDBBreakpoint* brk = gdbFindBreakpoint(addr);
+
+        // a user breakpoint or another thread's step at the same address stays
+        if (brk && brk->type == GDBBreakpointTypeTemporary && !gdbIsTemporaryBreakpointOwner(addr, NULL)) {
+            gdbRemoveBreakpoint(brk);
+        }
+    }
+}
+
+void gdbRemoveAllBreakpoints() {
+    u32 slot = 0;
+
+    while (slot < GDB_BREAKPOINT_TABLE_SIZE) {
+        struct GDBBreakpoint* brk = &gdbBreakpoints[slot];
+
+        if (brk->addr && !brk->isApplied) {
+            // deleting can shift another entry into this slot
+            gdbDeleteBreakpoint(brk);
+        } else {
+            if (brk->addr) {
+                brk->type = GDBBreakpointTypeNone;
+                gdbBreakpointsDirty = 1;
+            }
+            ++slot;
+        }
+    }
+
+    gdbTemporaryBreakpointCount = 0;
+}
+
+void gdbSuspendBreakpoint(u32 addr) {
+    struct GDBBreakpoint* brk = gdbLookupBreakpoint(addr);
+
+    if (brk) {
+        brk->isSuspended = 1;
+        gdbBreakpointsDirty = 1;
+    }
+}
+
+void gdbRearmBreakpoint(u32 addr) {
+    struct GDBBreakpoint* brk = gdbLookupBreakpoint(addr);
+
+    if (brk && brk->isSuspended) {
+        brk->isSuspended = 0;
+        gdbBreakpointsDirty = 1;
+    }
+}
+
+void gdbCommitBreakpoints() {
+    if (!gdbBreakpointsDirty) {
+        return;
+    }
+
+    u32 minAddr = ~0;
+    u32 maxAddr = 0;
+    u32 slot = 0;
+
+    while (slot < GDB_BREAKPOINT_TABLE_SIZE) {
+        struct GDBBreakpoint* brk = &gdbBreakpoints[slot];
+
+        if (!brk->addr) {
+            ++slot;
+            continue;
+        }
+
+        u8 shouldApply = brk->type != GDBBreakpointTypeNone && !brk->isSuspended;
+
+        if (shouldApply != brk->isApplied) {
+            if (shouldApply) {
+                brk->prevValue = *((u32*)brk->addr);
+                *((u32*)brk->addr) = GDB_TRAP_INSTRUCTION(GDB_TRAP_IS_BREAK_CODE);
+            } else {
+                *((u32*)brk->addr) = brk->prevValue;
+            }
+
+            brk->isApplied = shouldApply;
+
+            if (brk->addr < minAddr) {
+                minAddr = brk->addr;
+            }
+
+            if (brk->addr > maxAddr) {
+                maxAddr = brk->addr;
+            }
+        }
+
+        if (brk->type == GDBBreakpointTypeNone) {
+            // deleting can shift another entry into this slot
+            gdbDeleteBreakpoint(brk);
+        } else {
+            ++slot;
+        }
+    }
+
+    if (maxAddr) {
+        // one sync for the whole batch. large ranges flush the entire cache
+        osWritebackDCache((void*)minAddr, maxAddr - minAddr + sizeof(u32));
+        osInvalICache((void*)minAddr, maxAddr - minAddr + sizeof(u32));
+    }
+
+    gdbBreakpointsDirty = 0;
+}
+
+int gdbIsBreakpointRemoved(u32 addr) {
+    struct GDBBreakpoint* brk = gdbLookupBreakpoint(addr);
+    return brk && brk->type == GDBBreakpointTypeNone && brk->isApplied;
+}
+
+u32 gdbReadOriginalInstruction(u32 addr) {
+    struct GDBBreakpoint* brk = gdbLookupBreakpoint(addr);
+
+    if (brk && brk->isApplied) {
+        return brk->prevValue;
+    }
+
+    return *((u32*)addr);
+}
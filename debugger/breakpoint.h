@@ -0,0 +1,91 @@
+#ifndef __LIBULTRA_GDB_BREAKPOINT_H
+#define __LIBULTRA_GDB_BREAKPOINT_H
+
+#include <ultra64.h>
+
+#ifndef GDB_MAX_BREAK_POINTS
+#define GDB_MAX_BREAK_POINTS    1024
+#endif
+
+#define GDB_TRAP_IS_BREAK_CODE  0x123
+
+#define GDB_BREAK_INSTRUCTION(code) (0x0000000D | (((code) & 0xfffff) << 6))
+#define GDB_TRAP_INSTRUCTION(code) (0x00000034 | (((code) & 0x3ff) << 6))
+#define GDB_GET_TRAP_CODE(instr) (((instr) >> 6) & 0x3ff)
+
+enum GDBBreakpointType {
+    // the breakpoint is removed the next time breakpoints are committed
+    GDBBreakpointTypeNone,
+    // used by the debugger to step threads
+    GDBBreakpointTypeTemporary,
+    // collects a trace frame then continues
+    GDBBreakpointTypeTracepoint,
+    GDBBreakpointTypeUser,
+};
+
+struct GDBBreakpoint {
+    u32 addr;
+    u32 prevValue;
+    u8 type;
+    // the trap is currently written to memory
+    u8 isApplied;
+    // left out of memory while a thread steps over it
+    u8 isSuspended;
+    u32 hitCount;
+    // hits left before a thread stops at this breakpoint
+    u32 ignoreCount;
+};
+
+/**
+ * Finds the breakpoint at addr
+ * @returns NULL if there is no breakpoint at addr
+ */
+struct GDBBreakpoint* gdbFindBreakpoint(u32 addr);
+/**
+ * Adds a breakpoint. The trap isn't written until gdbCommitBreakpoints
+ * @returns NULL if there is no room for the breakpoint
+ */
+struct GDBBreakpoint* gdbInsertBreakPoint(u32 addr, enum GDBBreakpointType type);
+/**
+ * Removes a breakpoint. If the trap was never written the breakpoint
+ * is removed immediately, otherwise it is removed by gdbCommitBreakpoints
+ */
+void gdbRemoveBreakpoint(struct GDBBreakpoint* brk);
+/**
+ * Adds a breakpoint that steps owner. Threads share the breakpoint
+ * when they step through the same address
+ * @returns NULL if there is no room for the breakpoint
+ */
+struct GDBBreakpoint* gdbInsertTemporaryBreakpoint(u32 addr, OSThread* owner);
+/**
+ * Checks if thread placed a temporary breakpoint at addr. A NULL
+ * thread checks for a temporary breakpoint from any thread
+ */
+int gdbIsTemporaryBreakpointOwner(u32 addr, OSThread* thread);
+/**
+ * Removes the temporary breakpoints placed by owner
+ */
+void gdbRemoveTemporaryBreakpoints(OSThread* owner);
+void gdbRemoveAllBreakpoints();
+/**
+ * Keeps the trap at addr out of memory until gdbRearmBreakpoint
+ * so a thread stopped at addr can run the original instruction
+ */
+void gdbSuspendBreakpoint(u32 addr);
+void gdbRearmBreakpoint(u32 addr);
+/**
+ * Writes all staged breakpoint changes to memory then syncs the caches
+ * once for all of them
+ */
+void gdbCommitBreakpoints();
+/**
+ * Checks if addr has a trap in memory for a breakpoint that
+ * has been removed but not committed yet
+ */
+int gdbIsBreakpointRemoved(u32 addr);
+/**
+ * Reads the instruction at addr as it was before any trap was written
+ */
+u32 gdbReadOriginalInstruction(u32 addr);
+
+#endif
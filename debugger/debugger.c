@@ -1,63 +1,165 @@
 
 #include "debugger.h"
+#include "dispatch.h"
+#include "hex.h"
+#include "reply.h"
+#include "registers.h"
+#include "step.h"
+#include "breakpoint.h"
+#include "agent.h"
+#include "trace.h"
+#include "watch.h"
+#include "threads.h"
+#include "profiler.h"
+#include "zones.h"
+#include "libultra.h"
 #include <string.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdarg.h>
 
 #define MAX_PACKET_SIZE     0x4000
-#define MAX_DEBUGGER_THREADS    8
+// replies are streamed and large writes are decoded as they
+// are read so gdb can use packets larger than the buffers
+#define GDB_PACKET_SIZE_TEXT    "40000"
+// large enough for every register without the reply being flushed
+#define GDB_REGISTER_SNAPSHOT_SIZE  0x380
 
-#define GDB_ANY_THREAD      0
-#define GDB_ALL_THREADS     -1 
 
 #define GDB_STACKSIZE           0x400
 #define GDB_DEBUGGER_THREAD_ID  0xDBDB
 #define GDB_POLL_DELAY          (OS_CPU_COUNTER / 2)
+// used in non-stop mode where gdb keeps sending packets while threads run
 #define GDB_QUICK_POLL_DELAY    (OS_CPU_COUNTER / 100)
-#define GDB_QUICK_POLL_COUNT    20
+#define GDB_QUICK_POLLS_PER_POLL    (GDB_POLL_DELAY / GDB_QUICK_POLL_DELAY)
+// events can pile up while the debugger is handling packets
+#define GDB_EVENT_QUEUE_SIZE    8
 
 #define GDB_BRANCH_DELAY        0x80000000
 
 #define GDB_IS_ATTACHED         (1 << 0)
 #define GDB_IS_WAITING_STOP     (1 << 1)
+// the debugger is finishing steps without reporting them to gdb
+// QNonStop:1 was sent. Stops are reported with %Stop notifications
+#define GDB_IS_NON_STOP         (1 << 3)
+// a %Stop notification was sent and gdb hasn't drained the stops with vStopped
+#define GDB_IS_NOTIFYING        (1 << 4)
 
-#define GDB_TRAP_IS_BREAK_CODE  0x123
+#define GDB_GET_EXC_CODE(cause) (((cause) >> 2) & 0x1f)
 
-#define GDB_BREAK_INSTRUCTION(code) (0x0000000D | (((code) & 0xfffff) << 6))
-#define GDB_TRAP_INSTRUCTION(code) (0x00000034 | (((code) & 0x3ff) << 6))
-#define GDB_GET_TRAP_CODE(instr) (((instr) >> 6) & 0x3ff)
+#define GDB_WATCH_READ          0x2
+#define GDB_WATCH_WRITE         0x1
+// WatchLo matches a whole doubleword
+#define GDB_WATCH_ALIGN         0x8
 
-#define GDB_GET_EXC_CODE(cause) (((cause) >> 2) & 0x1f)
+#define GDB_CART_START          PHYS_TO_K1(PI_DOM1_ADDR2)
+#define GDB_CART_END            PHYS_TO_K1(0x1FC00000)
+#define GDB_IS_CART_ADDR(addr)  ((addr) >= GDB_CART_START && (addr) < GDB_CART_END)
+// the rcp registers and sp memory served by gdbTranslateAddr
+#define GDB_MMIO_START          PHYS_TO_K1(0x04000000)
+#define GDB_MMIO_SIZE           0x01000000
+// kseg2 and kseg3 are mapped through the tlb like kuseg
+#define GDB_K2_SIZE             0x40000000
 
-extern OSThread *	__osGetCurrFaultedThread(void);
-extern OSThread *	__osGetNextFaultedThread(OSThread *);
+#define GDB_MEMORY_MAP_SIZE     0x400
 
 // defined by makerom
 extern char     _codeSegmentDataStart[];
 extern char     _codeSegmentTextStart[];
 
-#define strStartsWith(str, constStr) (strncmp(str, constStr, sizeof constStr - 1) == 0)
+/**
+ * The encoded g reply for a stopped thread. gdb asks for the 
+ * registers many times while stopped so they are only encoded 
+ * once per stop
+ */
+struct GDBRegisterSnapshot {
+    // 0 when the snapshot needs to be rebuilt
+    u32 length;
+    char packet[GDB_REGISTER_SNAPSHOT_SIZE];
+};
+
+/**
+ * Steps the debugger finishes on its own without reporting to gdb
+ */
+struct GDBStepState {
+    // suspended so the thread can run the original instruction
+    u32 suspendedAddr;
+    u32 rangeStart;
+    // 0 when the thread isn't range stepping
+    u32 rangeEnd;
+    // continue once the step over suspendedAddr finishes
+    u8 continueAfterStep;
+    // gdb asked for a step with s or r so every breakpoint hit is reported.
+    // Zero for any other thread so ignored hits and tracepoints never stop it
+    u8 isStepping;
+    // the watch is cleared while the thread steps over the access that triggered it
+    u8 isWatchSuspended;
+    // stopped by vCont;t so the stop is reported with signal 0
+    u8 isStopRequested;
+};
+
+/**
+ * Tracks which stops gdb has been told about in non-stop mode
+ */
+enum GDBStopState {
+    GDBStopStateRunning,
+    // stopped but not reported to gdb yet
+    GDBStopStatePending,
+    GDBStopStateReported,
+};
 
-static OSThread* gdbTargetThreads[MAX_DEBUGGER_THREADS];
+static struct GDBRegisterSnapshot gdbRegisterSnapshots[GDB_MAX_THREADS];
+static struct GDBStepState gdbStepStates[GDB_MAX_THREADS];
+static u8 gdbStopStates[GDB_MAX_THREADS];
 static OSId gdbCurrentThreadG;
 static OSId gdbCurrentThreadg;
 static OSId gdbCurrentThreadc;
 static char gdbPacketBuffer[MAX_PACKET_SIZE];
 static char gdbOutputBuffer[MAX_PACKET_SIZE];
+static char gdbMemoryMap[GDB_MEMORY_MAP_SIZE];
+static u32 gdbMemoryMapLength;
 static int gdbRunFlags;
-static int gdbQuickPollCount;
 
 static OSThread gdbDebuggerThread;
 static u64 gdbDebuggerThreadStack[GDB_STACKSIZE/sizeof(u64)];
 
+/**
+ * Messages that wake the debugger thread
+ */
+enum GDBEvent {
+    // gdbPollTimer fired. Checks for packets from the host
+    GDBEventPoll,
+    // a quick poll that doesn't count toward the hang check
+    GDBEventQuickPoll,
+    // a thread hit a trap, break or other fault
+    GDBEventFault,
+    // the debugger stopped a thread with osStopThread
+    GDBEventStop,
+    // the profile buffer is half full
+    GDBEventProfile,
+    // a thread's zone buffer is half full
+    GDBEventZones,
+};
+
 static OSTimer gdbPollTimer;
+// gdbPollTimer can't be set again until it fires
+static u8 gdbIsPollTimerSet;
+static u8 gdbIsQuickPoll;
+// quick polls since the last GDBEventPoll
+static u8 gdbQuickPollCount;
 static OSMesgQueue gdbPollMesgQ;
-static OSMesg gdbPollMesgQMessage;
+static OSMesg gdbPollMesgQMessages[GDB_EVENT_QUEUE_SIZE];
 
 static enum GDBHangCheck gdbHangCheck = GDBHangCheckNone;
+// stopped when gdbHeartbeat isn't called for too long
+static OSThread* gdbHeartbeatThread;
 
-static struct GDBBreakpoint gdbBreakpoints[GDB_MAX_BREAK_POINTS];
+// the value WatchLo should have when no thread is stepping over a watch
+static u32 gdbWatchValue;
+// the watchpoint set by Z2, Z3 or Z4. gdbWatchType is 0 when gdb hasn't set one
+static u32 gdbWatchAddr;
+static u32 gdbWatchLength;
+static char gdbWatchType;
 
 void __gdbSetWatch(u32 value);
 u32 __gdbGetWatch();
@@ -106,111 +208,83 @@ u32 gdbGetFaultAddress(OSThread* thread) {
     }
 }
 
-OSThread* gdbFindThread(OSId id) {
-    int i;
-    for (i = 0; i < MAX_DEBUGGER_THREADS; ++i) {
-        if (gdbTargetThreads[i] && (
-            id == GDB_ANY_THREAD ||
-            osGetThreadId(gdbTargetThreads[i]) == id
-        )) {
-            return gdbTargetThreads[i];
-        }
-    }
-    return NULL;
+struct GDBRegisterSnapshot* gdbFindRegisterSnapshot(OSThread* thread) {
+    int index = gdbThreadIndex(thread);
+    return index == -1 ? NULL : &gdbRegisterSnapshots[index];
 }
 
-OSThread* gdbNextThread(OSThread* curr, OSId id) {
-    if (id == GDB_ALL_THREADS) {
-        int i;
-        for (i = 0; i < MAX_DEBUGGER_THREADS; ++i) {
-            if (curr == NULL && gdbTargetThreads[i]) {
-                return gdbTargetThreads[i];
-            } else if (curr != NULL && gdbTargetThreads[i] == curr) {
-                curr = NULL;
-            }
-        }
-
-        return NULL;
-    } else {
-        if (curr) {
-            return NULL;
-        } else {
-            return gdbFindThread(id);
-        }
-    }
+struct GDBStepState* gdbFindStepState(OSThread* thread) {
+    int index = gdbThreadIndex(thread);
+    return index == -1 ? NULL : &gdbStepStates[index];
 }
 
-int gdbReadHexDigit(char character) {
-    if (character >= 'a' && character <= 'f') {
-        return 10 + character - 'a';
-    } else if (character >= 'A' && character <= 'F') {
-        return 10 + character - 'A';
-    } else if (character >= '0' && character <= '9') {
-        return character - '0';
-    } else {
-        return -1;
-    }   
-}
+void gdbClearStepState(struct GDBStepState* step) {
+    if (step->suspendedAddr) {
+        gdbRearmBreakpoint(step->suspendedAddr);
+    }
 
-u32 gdbParseHex(char* src, u32 maxBytes) {
-    u32 result = 0;
-    int currentChar;
-    u32 maxCharacters = maxBytes * 2;
+    if (step->isWatchSuspended) {
+        __gdbSetWatch(gdbWatchValue);
+        gdbRearmTLBWatches();
+    }
 
-    for (currentChar = 0; currentChar < maxCharacters; ++currentChar) {
-        int digit = gdbReadHexDigit(*src);
+    bzero(step, sizeof(struct GDBStepState));
+}
 
-        if (digit != -1) {
-            result = (result << 4) + digit;
-        } else {
-            break;
-        }
+/**
+ * Puts back the breakpoint a thread stepped over and forgets
+ * any steps the debugger was finishing for it
+ */
+void gdbEndInternalStep(OSThread* thread) {
+    struct GDBStepState* step = gdbFindStepState(thread);
 
-        ++src;
+    if (step) {
+        gdbClearStepState(step);
     }
 
-    return result;
+    // steps placed by other threads are still running
+    gdbRemoveTemporaryBreakpoints(thread);
 }
 
-OSId gdbParseThreadId(char* src) {
-    if (src[0] == '-') {
-        return GDB_ALL_THREADS;
-    } else {
-        return gdbParseHex(src, 4);
+/**
+ * Picks up threads created since the last call and forgets
+ * the state of threads that were destroyed
+ */
+void gdbSyncThreads() {
+    u32 changed = gdbRefreshThreads();
+    int i;
+
+    for (i = 0; changed; ++i, changed >>= 1) {
+        if (changed & 1) {
+            gdbRegisterSnapshots[i].length = 0;
+            gdbClearStepState(&gdbStepStates[i]);
+            gdbStopStates[i] = GDBStopStateRunning;
+        }
     }
 }
 
-static char gdbHexLetters[16] = "0123456789abcdef";
+void gdbSetStopState(OSThread* thread, enum GDBStopState state) {
+    int index = gdbThreadIndex(thread);
 
-char* gdbWriteHex(char* target, u8* src, u32 bytes) {
-    u32 i;
-    for (i = 0; i < bytes; ++i) {
-        *target++ = gdbHexLetters[(*src) >> 4];
-        *target++ = gdbHexLetters[(*src) & 0xF];
-        ++src;
+    if (index != -1) {
+        gdbStopStates[index] = state;
     }
-    return target;
 }
 
-char* gdbReadHex(u8* target, char* src, u32 maxBytes) {
-    u32 i;
-    for (i = 0; i < maxBytes; ++i) {
-        int firstDigit = gdbReadHexDigit(*src++);
+void gdbInvalidateRegisters(OSThread* thread) {
+    struct GDBRegisterSnapshot* snapshot = gdbFindRegisterSnapshot(thread);
 
-        if (firstDigit == -1) {
-            return src;
-        } else {
-            int secondDigit = gdbReadHexDigit(*src++);
+    if (snapshot) {
+        snapshot->length = 0;
+    }
+}
 
-            if (secondDigit == -1) {
-                *target++ = firstDigit << 4;
-                return src;
-            } else {
-                *target++ = (firstDigit << 4) | secondDigit;
-            }
-        }
+OSId gdbParseThreadId(char* src) {
+    if (src[0] == '-') {
+        return GDB_ALL_THREADS;
+    } else {
+        return gdbParseHex(src, 4);
     }
-    return src;
 }
 
 void* gdbTranslateAddr(void* in) {
@@ -219,6 +293,12 @@ void* gdbTranslateAddr(void* in) {
     if ((physicalAddr & 0xFF000000) == 0x04000000 || (physicalAddr & 0xFF000000) == 0xA4000000) {
         return (void*)(PHYS_TO_K1(physicalAddr & 0x0FFFFFFF));
     } else {
+        void* watched = gdbTranslateWatchedAddr(physicalAddr);
+
+        if (watched) {
+            return watched;
+        }
+
         physicalAddr = osVirtualToPhysical(in);
 
         if (physicalAddr >= osMemSize) {
@@ -248,91 +328,11 @@ int gdbIsAlphaNum(int chr)
     return (chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') || (chr >= '0' && chr <= '9');
 }
 
-int gdbApplyChecksum(char* message)
-{
-    char* messageStart = message;
-    if (*message == '$') {
-        ++message;
-    }
-    
-    u8 checksum = 0;
-    while (*message)
-    {
-        if (*message == '#') {
-            ++message;
-            break;
-        }
-
-        checksum += (u8)*message;
-        ++message;
-    }
-
-    sprintf(message, "%02x", checksum);
-
-    return (message - messageStart) + 2;
-    return strlen(messageStart);
-}
-
-void gdbWriteInstruction(u32 addr, u32 value) {
-    *((u32*)addr) = value;
-    osWritebackDCache((void*)addr, sizeof(u32));
-    osInvalICache((void*)addr, sizeof(u32));
-}
-
-struct GDBBreakpoint* gdbFindBreakpoint(u32 addr) {
-    int i;
-    struct GDBBreakpoint* firstEmpty = NULL;
-    for (i = 0; i < GDB_MAX_BREAK_POINTS; ++i) {
-        if (!firstEmpty && gdbBreakpoints[i].type == GDBBreakpointTypeNone) {
-            firstEmpty = &gdbBreakpoints[i];
-        } else if (gdbBreakpoints[i].type != GDBBreakpointTypeNone && gdbBreakpoints[i].addr == addr) {
-            return &gdbBreakpoints[i];
-        }
-    }
-
-    return firstEmpty;
-}
-
-struct GDBBreakpoint* gdbInsertBreakPoint(u32 addr, enum GDBBreakpointType type) {
-    struct GDBBreakpoint* result = gdbFindBreakpoint(addr);
-
-    if (result) {
-        if (result->type == GDBBreakpointTypeNone) {
-            result->prevValue = *((u32*)addr);
-            gdbWriteInstruction(addr, GDB_TRAP_INSTRUCTION(GDB_TRAP_IS_BREAK_CODE));
-            result->type = type;
-        } else if (result->type < type) {
-            result->type = type;
-        }
-        result->addr = addr;
-    }
-
-    return result;
-}
-
-void gdbDisableBreakpoint(struct GDBBreakpoint* breakpoint) {
-    if (breakpoint && breakpoint->type == GDBBreakpointTypeUser) {
-        gdbWriteInstruction(breakpoint->addr, breakpoint->prevValue);
-        breakpoint->type = GDBBreakpointTypeUserUnapplied;
-    }
-}
-
-void gdbRenableBreakpoint(struct GDBBreakpoint* breakpoint) {
-    if (breakpoint && breakpoint->type == GDBBreakpointTypeUserUnapplied) {
-        breakpoint->prevValue = *((u32*)breakpoint->addr);
-        gdbWriteInstruction(breakpoint->addr, GDB_TRAP_INSTRUCTION(GDB_TRAP_IS_BREAK_CODE));
-        breakpoint->type = GDBBreakpointTypeUser;
-    }
-}
-
-void gdbRemoveBreakpoint(struct GDBBreakpoint* brk) {
-    if (brk && brk->type != GDBBreakpointTypeNone) {
-        if (brk->type != GDBBreakpointTypeUserUnapplied) {
-            gdbWriteInstruction(brk->addr, brk->prevValue);
-        }
-        brk->prevValue = 0;
-        brk->addr = 0;
-        brk->type = GDBBreakpointTypeNone;
+void gdbSyncMemory(void* addr, u32 len) {
+    if (len) {
+        // memory writes are frequently code being loaded by gdb
+        osWritebackDCache(addr, len);
+        osInvalICache(addr, len);
     }
 }
 
@@ -364,14 +364,73 @@ enum GDBError gdbParsePacket(char* input, u32 len, char **commandStart, char **p
     return GDBErrorBadPacket;
 }
 
+int gdbIsStoppedOnWatch(OSThread* thread) {
+    return (thread->flags & OS_FLAG_FAULT) && (thread->context.cause & CAUSE_EXCMASK) == EXC_WATCH;
+}
+
+/**
+ * WatchLo triggers on any access to the doubleword holding the 
+ * watchpoint. Returns non zero if the access that stopped thread
+ * overlaps the bytes gdb asked to watch
+ */
+int gdbIsWatchHit(OSThread* thread) {
+    u32 pc = gdbGetFaultAddress(thread);
+    u32 addr;
+    u32 size = gdbGetMemoryAccess(thread, gdbReadOriginalInstruction(pc), &addr);
+
+    if (!gdbWatchType || !size) {
+        return 1;
+    }
+
+    return addr < gdbWatchAddr + gdbWatchLength && gdbWatchAddr < addr + size;
+}
+
+void gdbReplyWatch(struct GDBReply* reply, char type, u32 addr) {
+    if (type == '2') {
+        gdbReplyString(reply, "watch:");
+    } else if (type == '3') {
+        gdbReplyString(reply, "rwatch:");
+    } else {
+        gdbReplyString(reply, "awatch:");
+    }
+
+    gdbReplyHexValue(reply, addr);
+    gdbReplyChar(reply, ';');
+}
+
 void gdbWaitForStop() {
     gdbRunFlags |= GDB_IS_WAITING_STOP;
 }
 
-enum GDBError gdbSendStopReply(OSThread* thread) {
-    char* current = gdbOutputBuffer;
+// sent with each stop so gdb can show the frame without reading every register
+static const u8 gdbExpeditedRegisters[] = {
+    GDB_REGISTER_PC,
+    GDB_REGISTER_SP,
+    GDB_REGISTER_RA,
+    GDB_REGISTER_FP,
+};
+
+/**
+ * Sends the T stop reply for thread
+ * @param startChar '$' for a reply or '%' for a %Stop notification
+ */
+enum GDBError gdbSendStop(OSThread* thread, char startChar) {
+    // the thread has run since the last stop
+    gdbInvalidateRegisters(thread);
+    gdbSetStopState(thread, GDBStopStateReported);
+
+    struct GDBReply reply;
+    struct GDBTLBWatch* tlbWatch;
+    struct GDBStepState* step = gdbFindStepState(thread);
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, startChar);
+
+    if (startChar == '%') {
+        gdbReplyString(&reply, "Stop:");
+    }
+
     int excCode = GDB_GET_EXC_CODE(thread->context.cause);
-    current += sprintf(current, "$T%02x", gdbSignals[excCode]);
+    gdbReplyChar(&reply, 'T');
+    gdbReplyHex8(&reply, step && step->isStopRequested ? 0 : gdbSignals[excCode]);
     u32 breakAddr = gdbGetFaultAddress(thread);
 
     u32 instr = gdbIsValidAddress((void*)breakAddr) ? *((u32*)breakAddr) : 0;
@@ -383,330 +442,1214 @@ enum GDBError gdbSendStopReply(OSThread* thread) {
         excCode == 9 || 
         // breakpoint simulated with trap code
         (excCode == 13 && trapCode == GDB_TRAP_IS_BREAK_CODE && GDB_TRAP_INSTRUCTION(trapCode) == instr)) {
-        current += sprintf(current, "swbreak:");
+        struct GDBBreakpoint* brk = gdbFindBreakpoint(breakAddr);
+
+        // stopping at the end of a step or on a tracepoint isn't a breakpoint to gdb
+        if (!brk || brk->type == GDBBreakpointTypeUser) {
+            gdbReplyString(&reply, "swbreak:;");
+        }
+    } else if (gdbIsStoppedOnWatch(thread) && gdbWatchType) {
+        gdbReplyWatch(&reply, gdbWatchType, gdbWatchAddr);
+    } else if ((tlbWatch = gdbFindTLBWatchHit(thread))) {
+        gdbReplyWatch(&reply, tlbWatch->type, tlbWatch->addr);
+    }
+
+    gdbReplyString(&reply, "thread:");
+    gdbReplyHexValue(&reply, osGetThreadId(thread));
+    gdbReplyChar(&reply, ';');
+
+    gdbEndInternalStep(thread);
+    // other threads may still be running
+    gdbCommitBreakpoints();
+
+    int i;
+    for (i = 0; i < sizeof(gdbExpeditedRegisters); ++i) {
+        gdbReplyHex8(&reply, gdbExpeditedRegisters[i]);
+        gdbReplyChar(&reply, ':');
+        gdbReplyRegister(&reply, thread, gdbExpeditedRegisters[i]);
+        gdbReplyChar(&reply, ';');
     }
 
-    current += sprintf(current, "thread:%d;", osGetThreadId(thread));
-    *current++ = '#';
-    *current++ = '\0';
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbSendStopReply(OSThread* thread) {
+    return gdbSendStop(thread, '$');
+}
 
+/**
+ * Replies with the next stop gdb hasn't seen or OK once every
+ * stop has been reported. Used by vStopped and ? in non-stop mode
+ */
+enum GDBError gdbReplyNextStop() {
     int i;
-    for (i = 0; i < GDB_MAX_BREAK_POINTS; ++i) {
-        gdbRenableBreakpoint(&gdbBreakpoints[i]);
+
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        if (gdbThreadAt(i) && gdbStopStates[i] == GDBStopStatePending) {
+            return gdbSendStopReply(gdbThreadAt(i));
+        }
     }
 
-    return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
+    gdbRunFlags &= ~GDB_IS_NOTIFYING;
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
 }
 
-void gdbResumeThread(OSThread* thread) {
+/**
+ * Where the thread continues when resumed
+ */
+u32 gdbResumeAddress(OSThread* thread) {
     if (thread->context.pc == (u32)gdbBreak) {
-        // hacky way to skip breakpoint instruction
-        thread->context.pc = (u32)thread->context.ra;
+        // gdbResumeThread skips the break instruction by returning from gdbBreak
+        return (u32)thread->context.ra;
+    }
+
+    return thread->context.pc;
+}
+
+/**
+ * @returns GDBErrorBadPacket if the debugger doesn't track the thread
+ */
+enum GDBError gdbResumeThread(OSThread* thread) {
+    struct GDBStepState* step = gdbFindStepState(thread);
+
+    if (!step) {
+        return GDBErrorBadPacket;
     }
-    if ((GDB_GET_EXC_CODE(thread->context.cause) & CAUSE_EXCMASK) == EXC_WATCH) {
-        // TODO restore watch point
+
+    gdbInvalidateRegisters(thread);
+    gdbSetStopState(thread, GDBStopStateRunning);
+
+    thread->context.pc = gdbResumeAddress(thread);
+
+    if (gdbIsStoppedOnWatch(thread) && gdbWatchValue) {
+        // the access would trigger the watch again. gdbStepThread
+        // is used to run it and the watch comes back after the step
         __gdbSetWatch(0);
+        step->isWatchSuspended = 1;
+    }
+
+    if (gdbIsTLBWatchFault(thread)) {
+        gdbSuspendTLBWatches();
+        step->isWatchSuspended = 1;
     }
-    gdbDisableBreakpoint(gdbFindBreakpoint(thread->context.pc));
+
+    if (gdbFindBreakpoint(thread->context.pc)) {
+        // the trap has to be out of memory for the thread to run the instruction
+        gdbSuspendBreakpoint(thread->context.pc);
+        step->suspendedAddr = thread->context.pc;
+    }
+
+    gdbCommitBreakpoints();
+
     // clear fault flag
     thread->flags &= ~OS_FLAG_FAULT;
 
-    // step commands will frequently string to together a lot
-    // of nearby breakpoints. This is to make sure stepping
-    // doesn't cause a huge delay
-    gdbQuickPollCount = GDB_QUICK_POLL_COUNT;
-    osStartThread(thread);
+    gdbStartThread(thread);
+
+    return GDBErrorNone;
 }
 
-enum GDBError gdbReplyRegisters() {
-    char* current = gdbOutputBuffer;
-    *current++ = '$';
+/**
+ * Runs a single instruction by placing temporary breakpoints 
+ * everywhere the thread could go next
+ */
+enum GDBError gdbStepThread(OSThread* thread) {
+    if (!gdbFindStepState(thread)) {
+        return GDBErrorBadPacket;
+    }
 
-    OSThread* thread = gdbFindThread(gdbCurrentThreadg);
+    u32 pc = gdbResumeAddress(thread);
+    u32 nextPCs[GDB_MAX_NEXT_PCS];
+    int nextCount = gdbGetNextPCs(thread, pc, gdbReadOriginalInstruction(pc), nextPCs);
+    int i;
 
-    if (thread) {
-        /* 0~ GPR0-31(yes, include zero),[32]PS(status),LO,HI,BadVAddr,Cause,PC,[38]FPR0-31,[70]fpcs,fpir,[72]..(dsp?),[90]end */
-        current += sprintf(current, "%08x%08x", 0, 0); // zero
-        current = gdbWriteHex(current, (u8*)&thread->context, offsetof(__OSThreadContext, gp));
-        current += sprintf(current, "%08x%08x", 0, 0); // k0
-        current += sprintf(current, "%08x%08x", 0, 0); // k1
-        current = gdbWriteHex(current, (u8*)&thread->context.gp, offsetof(__OSThreadContext, lo) - offsetof(__OSThreadContext, gp));
-
-        current += sprintf(current, "%08x%08x", 0, thread->context.sr);
-        current = gdbWriteHex(current, (u8*)&thread->context.lo, sizeof(u64) * 2);
-        current += sprintf(current, "%08x%08x", 0, thread->context.badvaddr);
-        current += sprintf(current, "%08x%08x", 0, thread->context.cause);
-        if (thread->context.pc == (u32)gdbBreak) {
-            // when inside gdbBreak, report the breakpoint to be at where the function was called
-            current += sprintf(current, "%08x%08x", 0, (u32)thread->context.ra);
-        } else {
-            current += sprintf(current, "%08x%08x", 0, thread->context.pc);
+    for (i = 0; i < nextCount; ++i) {
+        // a branch to itself can't be stepped with a breakpoint
+        if (nextPCs[i] != pc && gdbIsValidAddress((void*)nextPCs[i])) {
+            if (!gdbInsertTemporaryBreakpoint(nextPCs[i], thread)) {
+                // the thread would run past the step
+                gdbRemoveTemporaryBreakpoints(thread);
+                return GDBErrorBufferTooSmall;
+            }
         }
-
-        current = gdbWriteHex(current, (u8*)&thread->context.fp0, sizeof(__OSThreadContext) - offsetof(__OSThreadContext, fp0));
-        current += sprintf(current, "%08x%08x", 0, thread->context.fpcsr);
     }
 
-    *current++ = '#';
-    *current++ = '\0';
-
-    return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
+    return gdbResumeThread(thread);
 }
 
-enum GDBError gdbWriteRegisters(char* commandStart, char *packetEnd) {
-    
-    OSThread* thread = gdbFindThread(gdbCurrentThreadg);
-
-    char* current = commandStart + 1;
-    u32 messageLength = (u32)(packetEnd - current);
+/**
+ * Resumes a thread. A thread stopped on a breakpoint or watch first 
+ * steps over it so it can be put back before the thread continues
+ */
+enum GDBError gdbContinueThread(OSThread* thread) {
+    struct GDBStepState* step = gdbFindStepState(thread);
 
-    if (messageLength != 880) {
+    if (!step) {
         return GDBErrorBadPacket;
     }
 
-    if (thread) {
-        current += 16; // zero register
-        current = gdbReadHex((u8*)&thread->context, current, offsetof(__OSThreadContext, gp));
-        current += 32; // k0 and k1
-        current = gdbReadHex((u8*)&thread->context.gp, current, offsetof(__OSThreadContext, lo) - offsetof(__OSThreadContext, gp));
-        current += 8; current = gdbReadHex((u8*)&thread->context.sr, current, sizeof(u32));
-        current = gdbReadHex((u8*)&thread->context.lo, current, sizeof(u64) * 2);
-        current += 8; current = gdbReadHex((u8*)&thread->context.badvaddr, current, sizeof(u32));
-        current += 8; current = gdbReadHex((u8*)&thread->context.cause, current, sizeof(u32));
-        current += 8; current = gdbReadHex((u8*)&thread->context.pc, current, sizeof(u32));
-        current = gdbReadHex((u8*)&thread->context.fp0, current, sizeof(__OSThreadContext) - offsetof(__OSThreadContext, fp0));
-        current += 8; current = gdbReadHex((u8*)&thread->context.fpcsr, current, sizeof(u32));
+    if (gdbFindBreakpoint(gdbResumeAddress(thread)) || gdbIsStoppedOnWatch(thread) || gdbIsTLBWatchFault(thread)) {
+        step->continueAfterStep = 1;
+        return gdbStepThread(thread);
     }
-    
-    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+
+    return gdbResumeThread(thread);
 }
 
-enum GDBError gdbReplyMemory(char* commandStart, char *packetEnd) {
-    u32 prevWatch = __gdbGetWatch();
-    // clear the watch so the debugger thread doesn't get the interrupt
-    __gdbSetWatch(0);
-    char* current = gdbOutputBuffer;
-    *current++ = '$';
+/**
+ * Called when a thread stops. Finishes steps the debugger started on
+ * its own and skips breakpoints with an ignore count. Returns non zero
+ * if the thread was resumed and the stop shouldn't be reported to gdb
+ */
+int gdbContinueInternalStep(OSThread* thread) {
+    struct GDBStepState* step = gdbFindStepState(thread);
 
-    char* lenText = commandStart + 1;
+    if (!step || !(thread->flags & OS_FLAG_FAULT)) {
+        return 0;
+    }
 
-    while (*lenText != ',') {
-        if (lenText == packetEnd) {
-            return GDBErrorBadPacket;
-        }
-        ++lenText;
+    u32 pc = thread->context.pc;
+
+    if (step->isWatchSuspended) {
+        __gdbSetWatch(gdbWatchValue);
+        gdbRearmTLBWatches();
+        step->isWatchSuspended = 0;
     }
 
-    vu8* dataSrc = (vu8*)gdbTranslateAddr((u8*)gdbParseHex(commandStart + 1, 4));
-    u32 len = gdbParseHex(lenText + 1, 4);
+    if (gdbIsStoppedOnWatch(thread) && !step->isStepping && !gdbIsWatchHit(thread)) {
+        // another part of the doubleword was accessed
+        gdbContinueThread(thread);
+        return 1;
+    }
 
-    while (len > 0) {
-        u8 word= 0;
-        
-        if (dataSrc) {
-            word = *dataSrc;
-        }
-        
-        current = gdbWriteHex(current, &word, 1);
-        --len;
-        if (dataSrc) {
-            ++dataSrc;
+    if (gdbIsTLBWatchFault(thread) && !gdbFindTLBWatchHit(thread)) {
+        // the access missed every watch on the page
+        if (step->isStepping) {
+            gdbStepThread(thread);
+        } else {
+            gdbContinueThread(thread);
         }
+        return 1;
     }
 
-    *current++ = '#';
-    *current++ = '\0';
-    __gdbSetWatch(prevWatch);
-    return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-}
-
-enum GDBError gdbWriteMemory(char *commandStart, char* packetEnd) {
-    u32 prevWatch = __gdbGetWatch();
-    // clear the watch so the debugger thread doesn't get the interrupt
-    __gdbSetWatch(0);
-    char* current = gdbOutputBuffer;
-    *current++ = '$';
+    // trap exception
+    if (GDB_GET_EXC_CODE(thread->context.cause) == 13 && gdbIsBreakpointRemoved(pc)) {
+        // hit a breakpoint gdb already removed before the removal was committed
+        gdbResumeThread(thread);
+        return 1;
+    }
 
-    char* lenText = commandStart + 1;
+    struct GDBBreakpoint* brk = gdbFindBreakpoint(pc);
 
-    while (*lenText != ',') {
-        if (lenText == packetEnd) {
-            return GDBErrorBadPacket;
-        }
-        ++lenText;
+    if (!brk) {
+        return 0;
     }
 
-    char* dataText = lenText + 1;
-
-    while (*dataText != ':') {
-        if (dataText == packetEnd) {
-            return GDBErrorBadPacket;
-        }
-        ++dataText;
+    if (step->suspendedAddr) {
+        gdbRearmBreakpoint(step->suspendedAddr);
+        step->suspendedAddr = 0;
     }
 
-    ++dataText;
+    if (brk->type == GDBBreakpointTypeTemporary && !gdbIsTemporaryBreakpointOwner(pc, thread)) {
+        // another thread is stepping through this address
+        gdbContinueThread(thread);
+        return 1;
+    }
 
-    u8* dataTarget = gdbTranslateAddr((u8*)gdbParseHex(commandStart + 1, 4));
-    if (dataTarget) {
-        u32 len = gdbParseHex(lenText + 1, 4);
-        gdbReadHex(dataTarget, dataText, len);
+    if (gdbIsTracing()) {
+        gdbCollectTraceFrames(pc, thread);
     }
-    __gdbSetWatch(prevWatch);
-    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
-}
 
-enum GDBError gdbHandleQuery(char* commandStart, char *packetEnd) {
-    if (strStartsWith(commandStart, "qSupported")) {
-        strcpy(gdbOutputBuffer, "$PacketSize=4000;vContSupported+;swbreak+#");
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-    } else if (strStartsWith(commandStart, "qTStatus")) {
-        return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
-    } else if (strStartsWith(commandStart, "qfThreadInfo")) {
-        strcpy(gdbOutputBuffer, "$m");
-        char* outputWrite = gdbOutputBuffer + 2;
-        int i;
-        int first = 1;
-        for (i = 0; i < MAX_DEBUGGER_THREADS; ++i) {
-            if (gdbTargetThreads[i]) {
-                if (first) {    
-                    first = 0;
-                    outputWrite += sprintf(outputWrite, "%x", osGetThreadId(gdbTargetThreads[i]));
-                } else {
-                    outputWrite += sprintf(outputWrite, ",%x", osGetThreadId(gdbTargetThreads[i]));
-                }
-            }
-        }
-        *outputWrite++ = '#';
-        *outputWrite++ = '\0';
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-    } else if (strStartsWith(commandStart, "qsThreadInfo")) {
-        strcpy(gdbOutputBuffer, "$l#");
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-    } else if (strStartsWith(commandStart, "qAttached")) {
-        strcpy(gdbOutputBuffer, "$0#");
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-    } else if (strStartsWith(commandStart, "qC")) {
-        strcpy(gdbOutputBuffer, "$QC");
-        char* outputWrite = gdbOutputBuffer + 3;
-        int i;
-        for (i = 0; i < MAX_DEBUGGER_THREADS; ++i) {
-            if (gdbTargetThreads[i]) {
-                outputWrite += sprintf(outputWrite, "%x", osGetThreadId(gdbTargetThreads[i]));
-                break;
-            }
-        }
+    if (brk->type == GDBBreakpointTypeUser && gdbCheckConditions(pc, thread)) {
+        ++brk->hitCount;
 
-        if (i == MAX_DEBUGGER_THREADS) {
-            strcpy(gdbOutputBuffer, "$E00#");
+        if (gdbRunCommands(pc, thread)) {
+            // dprintf breakpoints print on the target and keep going
+        } else if (brk->ignoreCount == 0 || step->isStepping) {
+            return 0;
         } else {
-            *outputWrite++ = '#';
-            *outputWrite++ = '\0';
+            --brk->ignoreCount;
         }
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-    } else if (strStartsWith(commandStart, "qTfV")) {
-        return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
-    } else if (strStartsWith(commandStart, "qTfP")) {
-        return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
-    } else if (strStartsWith(commandStart, "qOffsets")) {
-        // 0x20 is a magic number. I don't know why but it makes the addresses line up correctly
-        sprintf(gdbOutputBuffer, "$Text=%x;Data=%x;Bss=%x#", 0, 0, 0);
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-    } else if (strStartsWith(commandStart, "qSymbol")) {
-        return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
-    } else if (strStartsWith(commandStart, "qThreadExtraInfo")) {
-        OSId threadId = gdbParseHex(commandStart + sizeof("qThreadExtraInfo"), 4);
+    }
 
-        OSThread* thread = gdbFindThread(threadId);
+    if (brk->type >= GDBBreakpointTypeTracepoint && !step->isStepping) {
+        gdbRemoveTemporaryBreakpoints(thread);
+        gdbContinueThread(thread);
+        return 1;
+    }
 
-        if (thread) {
-            int strLen = sprintf(gdbOutputBuffer + 0x200, "state %d priority %d", thread->state, thread->priority);
-            gdbOutputBuffer[0] = '$';
-            char* nextOut = gdbWriteHex(gdbOutputBuffer + 1, (u8*)gdbOutputBuffer + 0x200, strLen);
-            *nextOut++ = '#';
-        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-        } else {
-            return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
-        }
+    if (step->continueAfterStep) {
+        step->continueAfterStep = 0;
+        gdbRemoveTemporaryBreakpoints(thread);
+        gdbResumeThread(thread);
+        return 1;
     }
 
-    return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
+    if (step->rangeEnd && pc >= step->rangeStart && pc < step->rangeEnd) {
+        gdbRemoveTemporaryBreakpoints(thread);
+        gdbStepThread(thread);
+        return 1;
+    }
+
+    return 0;
 }
 
-enum GDBError gdbHandleV(char* commandStart, char *packetEnd) {
-    if (strStartsWith(commandStart, "vMustReplyEmpty")) {
+enum GDBError gdbReplyRegisters() {
+    OSThread* thread = gdbFindThread(gdbCurrentThreadg);
+
+    if (gdbIsTraceFrameSelected()) {
+        struct GDBReply reply;
+        gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+
+        int regNum;
+        for (regNum = 0; regNum < GDB_REGISTER_COUNT; ++regNum) {
+            gdbReplyTraceFrameRegister(&reply, regNum);
+        }
+
+        return gdbReplySend(&reply);
+    }
+
+    if (!thread) {
         return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
-    } else if (strStartsWith(commandStart, "vCont")) {
-        if (commandStart[5] == '?') {
-            strcpy(gdbOutputBuffer, "$c;t#");
-            return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
-        } else {
-            OSId threadId;
+    }
 
-            char* idLoc = commandStart + 6;
-            while (idLoc < packetEnd && *idLoc++ != ':');
+    struct GDBRegisterSnapshot* snapshot = gdbFindRegisterSnapshot(thread);
 
-            if (idLoc < packetEnd && *idLoc != '#') {
-                threadId = gdbParseThreadId(idLoc);
-            } else {
-                threadId = GDB_ALL_THREADS;
-            }
+    if (thread->state != OS_STATE_STOPPED) {
+        // registers of a running thread can change at any time
+        snapshot->length = 0;
+    }
 
-            OSThread *thread = NULL;
+    if (!snapshot->length) {
+        struct GDBReply reply;
+        gdbReplyStart(&reply, snapshot->packet, GDB_REGISTER_SNAPSHOT_SIZE, '$');
 
-            while ((thread = gdbNextThread(thread, threadId))) {
-                switch (commandStart[6])
-                {
-                case 'C':
-                case 'c':
-                {
-                    gdbResumeThread(thread);
-                    break;
-                }
-                case 's':
-                {
-                    // TODO
-                    break;
-                }
-                case 't':
-                {
-                    osStopThread(thread);
-                    break;
-                }
-                case 'r':
-                {
-                    // TODO
-                    break;
-                }
-                }
-            }
+        int regNum;
 
-            gdbWaitForStop();
-            return GDBErrorNone;
+        for (regNum = 0; regNum < GDB_REGISTER_COUNT; ++regNum) {
+            gdbReplyRegister(&reply, thread, regNum);
         }
-    } else if (strStartsWith(commandStart, "vKill")) {
-        int i;
-        for (i = 0; i < GDB_MAX_BREAK_POINTS; ++i) {
-            gdbRemoveBreakpoint(&gdbBreakpoints[i]);
+
+        snapshot->length = gdbReplyFinish(&reply);
+    }
+
+    return gdbSendMessage(GDBDataTypeGDB, snapshot->packet, snapshot->length);
+}
+
+/**
+ * Accepts the registers with or without the fpu registers at the end
+ */
+enum GDBError gdbWriteRegisters(char* commandStart, char *packetEnd) {
+    OSThread* thread = gdbFindThread(gdbCurrentThreadg);
+
+    char* current = commandStart + 1;
+    u32 messageLength = (u32)(packetEnd - current);
+    int registerCount;
+
+    if (messageLength == 880) {
+        registerCount = GDB_REGISTER_COUNT;
+    } else if (messageLength == 608) {
+        registerCount = GDB_FIRST_FPU_REGISTER;
+    } else {
+        return GDBErrorBadPacket;
+    }
+
+    if (thread) {
+        int regNum;
+
+        for (regNum = 0; regNum < registerCount; ++regNum) {
+            current = gdbWriteRegister(thread, regNum, current);
+        }
+
+        gdbInvalidateRegisters(thread);
+    }
+    
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbReplySingleRegister(char* commandStart, char *packetEnd) {
+    OSThread* thread = gdbFindThread(gdbCurrentThreadg);
+    u32 regNum = gdbParseHex(commandStart + 1, 4);
+
+    if ((!thread && !gdbIsTraceFrameSelected()) || regNum >= GDB_REGISTER_COUNT) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E00#a5", strlen("$E00#a5"));
+    }
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+
+    if (gdbIsTraceFrameSelected()) {
+        gdbReplyTraceFrameRegister(&reply, regNum);
+    } else {
+        gdbReplyRegister(&reply, thread, regNum);
+    }
+
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbWriteSingleRegister(char* commandStart, char *packetEnd) {
+    OSThread* thread = gdbFindThread(gdbCurrentThreadg);
+    char* value = commandStart + 1;
+
+    while (*value != '=') {
+        if (value == packetEnd) {
+            return GDBErrorBadPacket;
+        }
+        ++value;
+    }
+
+    u32 regNum = gdbParseHex(commandStart + 1, 4);
+    ++value;
+
+    if (!thread || regNum >= GDB_REGISTER_COUNT || packetEnd - value != gdbRegisterSize(regNum) * 2) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E00#a5", strlen("$E00#a5"));
+    }
+
+    gdbWriteRegister(thread, regNum, value);
+    gdbInvalidateRegisters(thread);
+
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+char* gdbParseAddressLength(char* src, char* packetEnd, u32* addr, u32* len) {
+    char* lenText = src;
+
+    while (*lenText != ',') {
+        if (lenText == packetEnd) {
+            return NULL;
+        }
+        ++lenText;
+    }
+
+    *addr = gdbParseAddress(src);
+    *len = gdbParseHex(lenText + 1, 4);
+
+    while (lenText < packetEnd && *lenText != ':') {
+        ++lenText;
+    }
+
+    return lenText;
+}
+
+/**
+ * Limits len so a read starting at translated doesn't run
+ * off the end of the memory region it starts in
+ */
+u32 gdbReadableLength(void* translated, u32 len) {
+    u32 addr = (u32)translated;
+    u32 limit;
+
+    if (!addr) {
+        return 0;
+    } else if ((addr & 0xFF000000) == 0xA4000000) {
+        limit = 0xA5000000;
+    } else if (GDB_IS_CART_ADDR(addr)) {
+        limit = GDB_CART_END;
+    } else {
+        limit = PHYS_TO_K0(osMemSize);
+    }
+
+    if (addr >= limit) {
+        return 0;
+    }
+
+    // addr + len can wrap for large lengths
+    if (len > limit - addr) {
+        return limit - addr;
+    }
+
+    return len;
+}
+
+/**
+ * Reads memory collected in the selected trace frame. Memory 
+ * that wasn't collected is an error
+ */
+enum GDBError gdbReplyTraceMemory(u32 addr, u32 len, int isBinary) {
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+
+    if (isBinary) {
+        gdbReplyChar(&reply, 'b');
+    }
+
+    if (!gdbReplyTraceFrameMemory(&reply, addr, len, isBinary)) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+    }
+
+    return gdbReplySend(&reply);
+}
+
+/**
+ * Handles both m (hex) and x (binary) memory reads. Replies
+ * longer than gdbOutputBuffer are sent in pieces
+ */
+enum GDBError gdbReplyMemory(char* commandStart, char *packetEnd) {
+    u32 addr;
+    u32 len;
+
+    if (!gdbParseAddressLength(commandStart + 1, packetEnd, &addr, &len)) {
+        return GDBErrorBadPacket;
+    }
+
+    int isBinary = *commandStart == 'x';
+
+    if (gdbIsTraceFrameSelected()) {
+        return gdbReplyTraceMemory(addr, len, isBinary);
+    }
+
+    u32 prevWatch = __gdbGetWatch();
+    // clear the watch so the debugger thread doesn't get the interrupt
+    __gdbSetWatch(0);
+
+    // the cart isn't in gdbTranslateAddr since it can't be written to
+    int isCart = GDB_IS_CART_ADDR(addr);
+    u32 readAddr = isCart ? addr : (u32)gdbTranslateAddr((u8*)addr);
+    u32 readableLen = gdbReadableLength((void*)readAddr, len);
+    u32 cartWord = 0;
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+
+    if (isBinary) {
+        gdbReplyChar(&reply, 'b');
+    }
+
+    while (len > 0 && reply.error == GDBErrorNone) {
+        u8 word = 0;
+
+        if (readableLen) {
+            if (isCart) {
+                // the PI only reads whole words
+                if (readAddr == addr || (readAddr & 0x3) == 0) {
+                    osPiReadIo(K1_TO_PHYS(readAddr) & ~0x3, &cartWord);
+                }
+                word = (u8)(cartWord >> ((3 - (readAddr & 0x3)) * 8));
+            } else {
+                word = *(vu8*)readAddr;
+            }
+            ++readAddr;
+            --readableLen;
+        }
+
+        if (isBinary) {
+            gdbReplyBinary(&reply, &word, 1);
+        } else {
+            gdbReplyHex8(&reply, word);
+        }
+
+        --len;
+    }
+
+    __gdbSetWatch(prevWatch);
+    return gdbReplySend(&reply);
+}
+
+struct GDBMemoryWriter {
+    u8* target;
+    u8* start;
+    u32 remaining;
+    u8 isBinary;
+    u8 isEscaped;
+    s8 highNibble;
+};
+
+void gdbStartMemoryWrite(struct GDBMemoryWriter* writer, u32 addr, u32 len, int isBinary) {
+    writer->target = gdbTranslateAddr((u8*)addr);
+    writer->start = writer->target;
+    writer->remaining = len;
+    writer->isBinary = isBinary;
+    writer->isEscaped = 0;
+    writer->highNibble = -1;
+}
+
+/**
+ * Decodes packet data into memory. Can be called multiple times
+ * for packets that don't fit into gdbPacketBuffer. Returns non
+ * zero once the end of the packet data is reached
+ */
+int gdbMemoryWrite(struct GDBMemoryWriter* writer, char* data, char* dataEnd) {
+    while (writer->remaining && data < dataEnd) {
+        u8 value = *data++;
+
+        // '#' is always escaped in binary data
+        if (value == '#') {
+            return 1;
         }
-        for (i = 0; i < MAX_DEBUGGER_THREADS; ++i) {
-            if (gdbTargetThreads[i] && gdbTargetThreads[i]->state == OS_STATE_STOPPED) {
-                gdbResumeThread(gdbTargetThreads[i]);
+
+        if (writer->isBinary) {
+            if (writer->isEscaped) {
+                value ^= GDB_BINARY_ESCAPE_XOR;
+                writer->isEscaped = 0;
+            } else if (value == GDB_BINARY_ESCAPE) {
+                writer->isEscaped = 1;
+                continue;
+            }
+        } else {
+            int digit = gdbReadHexDigit(value);
+
+            if (digit == -1) {
+                return 1;
+            } else if (writer->highNibble == -1) {
+                writer->highNibble = digit;
+                continue;
             }
+
+            value = (writer->highNibble << 4) | digit;
+            writer->highNibble = -1;
+        }
+
+        if (writer->target) {
+            *writer->target++ = value;
         }
-        gdbRunFlags &= ~GDB_IS_ATTACHED;
+
+        --writer->remaining;
+    }
+
+    return writer->remaining == 0;
+}
+
+void gdbFinishMemoryWrite(struct GDBMemoryWriter* writer) {
+    if (writer->target) {
+        gdbSyncMemory(writer->start, writer->target - writer->start);
+    }
+}
+
+/**
+ * Handles both M (hex) and X (binary) memory writes
+ */
+enum GDBError gdbWriteMemory(char *commandStart, char* packetEnd) {
+    u32 addr;
+    u32 len;
+    char* dataText = gdbParseAddressLength(commandStart + 1, packetEnd, &addr, &len);
+
+    if (!dataText || dataText == packetEnd) {
+        return GDBErrorBadPacket;
+    }
+
+    u32 prevWatch = __gdbGetWatch();
+    // clear the watch so the debugger thread doesn't get the interrupt
+    __gdbSetWatch(0);
+
+    // gdb probes for X support with an empty write
+    struct GDBMemoryWriter writer;
+    gdbStartMemoryWrite(&writer, addr, len, *commandStart == 'X');
+    gdbMemoryWrite(&writer, dataText + 1, packetEnd);
+    gdbFinishMemoryWrite(&writer);
+
+    __gdbSetWatch(prevWatch);
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+/**
+ * Handles a packet that doesn't fit in gdbPacketBuffer. The
+ * advertised PacketSize is larger than the buffer so large
+ * memory writes are decoded as they are read from the cart
+ */
+enum GDBError gdbHandleLongPacket(u32 bufferedLen) {
+    char* bufferEnd = gdbPacketBuffer + bufferedLen;
+    char* commandStart = memchr(gdbPacketBuffer, '$', bufferedLen);
+    char* dataText = NULL;
+    u32 addr;
+    u32 len;
+    enum GDBError err;
+
+    if (commandStart && (commandStart[1] == 'M' || commandStart[1] == 'X')) {
+        ++commandStart;
+        dataText = gdbParseAddressLength(commandStart + 1, bufferEnd, &addr, &len);
+    }
+
+    if (dataText && dataText < bufferEnd) {
+        u32 prevWatch = __gdbGetWatch();
+        __gdbSetWatch(0);
+
+        struct GDBMemoryWriter writer;
+        gdbStartMemoryWrite(&writer, addr, len, *commandStart == 'X');
+        int isDone = gdbMemoryWrite(&writer, dataText + 1, bufferEnd);
+
+        while (!isDone) {
+            err = gdbReadData(gdbPacketBuffer, MAX_PACKET_SIZE, &bufferedLen);
+            if (err != GDBErrorNone || bufferedLen == 0) break;
+            isDone = gdbMemoryWrite(&writer, gdbPacketBuffer, gdbPacketBuffer + bufferedLen);
+        }
+
+        gdbFinishMemoryWrite(&writer);
+        __gdbSetWatch(prevWatch);
+    } else {
+        dataText = NULL;
+    }
+
+    err = gdbFinishRead();
+    if (err != GDBErrorNone) return err;
+
+    err = gdbSendMessage(GDBDataTypeGDB, "+", strlen("+"));
+    if (err != GDBErrorNone) return err;
+
+    if (dataText) {
         return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+    } else {
+        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+    }
+}
+
+enum GDBError gdbHandleQSupported(char* commandStart, char *packetEnd) {
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyString(&reply, "PacketSize=" GDB_PACKET_SIZE_TEXT ";vContSupported+;swbreak+;binary-upload+;qXfer:memory-map:read+;qXfer:features:read+;ConditionalBreakpoints+;ConditionalTracepoints+;BreakpointCommands+;QNonStop+");
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbHandleQfThreadInfo(char* commandStart, char *packetEnd) {
+    gdbSyncThreads();
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyChar(&reply, 'm');
+    int i;
+    int first = 1;
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        if (gdbThreadAt(i)) {
+            if (first) {    
+                first = 0;
+            } else {
+                gdbReplyChar(&reply, ',');
+            }
+            gdbReplyHexValue(&reply, osGetThreadId(gdbThreadAt(i)));
+        }
+    }
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbHandleQsThreadInfo(char* commandStart, char *packetEnd) {
+    return gdbSendMessage(GDBDataTypeGDB, "$l#6c", strlen("$l#6c"));
+}
+
+enum GDBError gdbHandleQAttached(char* commandStart, char *packetEnd) {
+    return gdbSendMessage(GDBDataTypeGDB, "$0#30", strlen("$0#30"));
+}
+
+enum GDBError gdbHandleQC(char* commandStart, char *packetEnd) {
+    OSThread* thread = gdbFindThread(GDB_ANY_THREAD);
+
+    if (!thread) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E00#a5", strlen("$E00#a5"));
+    }
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyString(&reply, "QC");
+    gdbReplyHexValue(&reply, osGetThreadId(thread));
+    return gdbReplySend(&reply);
+}
+
+/**
+ * qN64BreakHits:addr replies with the hit count and 
+ * remaining ignore count of a breakpoint as hits,ignore
+ */
+enum GDBError gdbHandleQN64BreakHits(char* commandStart, char *packetEnd) {
+    u32 addr = gdbParseAddress(commandStart + sizeof("qN64BreakHits"));
+    struct GDBBreakpoint* brk = gdbFindBreakpoint(addr);
+
+    if (!brk) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E00#a5", strlen("$E00#a5"));
+    }
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyHexValue(&reply, brk->hitCount);
+    gdbReplyChar(&reply, ',');
+    gdbReplyHexValue(&reply, brk->ignoreCount);
+    return gdbReplySend(&reply);
+}
+
+/**
+ * QN64BreakIgnore:addr,count skips the next count hits of a 
+ * breakpoint without stopping
+ */
+enum GDBError gdbHandleQN64BreakIgnore(char* commandStart, char *packetEnd) {
+    u32 addr;
+    u32 count;
+
+    if (!gdbParseAddressLength(commandStart + sizeof("QN64BreakIgnore"), packetEnd, &addr, &count)) {
+        return GDBErrorBadPacket;
+    }
+
+    struct GDBBreakpoint* brk = gdbFindBreakpoint(addr);
+
+    if (!brk) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E00#a5", strlen("$E00#a5"));
+    }
+
+    brk->ignoreCount = count;
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+/**
+ * QN64Profile:rate starts the profiler at rate samples per 
+ * second in hex. A rate of 0 stops it
+ */
+enum GDBError gdbHandleQN64Profile(char* commandStart, char *packetEnd) {
+    char* rateStart = commandStart + sizeof("QN64Profile");
+
+    if (rateStart >= packetEnd) {
+        return GDBErrorBadPacket;
+    }
+
+    gdbStartProfiler(gdbParseHex(rateStart, 4));
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+/**
+ * QN64Zones:1 starts recording zones and counters. QN64Zones:0 stops
+ */
+enum GDBError gdbHandleQN64Zones(char* commandStart, char *packetEnd) {
+    char* valueStart = commandStart + sizeof("QN64Zones");
+
+    if (valueStart >= packetEnd) {
+        return GDBErrorBadPacket;
+    }
+
+    if (*valueStart == '1') {
+        gdbStartZones();
+    } else {
+        gdbStopZones();
+    }
+
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbHandleQOffsets(char* commandStart, char *packetEnd) {
+    return gdbSendMessage(GDBDataTypeGDB, "$Text=0;Data=0;Bss=0#04", strlen("$Text=0;Data=0;Bss=0#04"));
+}
+
+enum GDBError gdbHandleQSymbol(char* commandStart, char *packetEnd) {
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbHandleQThreadExtraInfo(char* commandStart, char *packetEnd) {
+    OSId threadId = gdbParseHex(commandStart + sizeof("qThreadExtraInfo"), 4);
+
+    OSThread* thread = gdbFindThread(threadId);
+
+    if (thread) {
+        char extraInfo[32];
+        char* current = extraInfo;
+        strcpy(current, "state ");
+        current = gdbFormatDecimal(current + strlen("state "), thread->state);
+        strcpy(current, " priority ");
+        current = gdbFormatDecimal(current + strlen(" priority "), thread->priority);
+
+        struct GDBReply reply;
+        gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+        gdbReplyHexBytes(&reply, (u8*)extraInfo, current - extraInfo);
+        return gdbReplySend(&reply);
+    } else {
+        return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
+    }
+}
+
+enum GDBError gdbHandleQTinit(char* commandStart, char *packetEnd) {
+    gdbClearTracepoints();
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbHandleQTDP(char* commandStart, char *packetEnd) {
+    if (gdbDefineTracepoint(commandStart + sizeof("QTDP"), packetEnd) != GDBErrorNone) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+    }
+
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbHandleQTStart(char* commandStart, char *packetEnd) {
+    if (gdbStartTrace() != GDBErrorNone) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+    }
+
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbHandleQTStop(char* commandStart, char *packetEnd) {
+    gdbStopTrace();
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+/**
+ * QTBuffer:circular:1 keeps the newest frames once the buffer fills
+ */
+enum GDBError gdbHandleQTBuffer(char* commandStart, char *packetEnd) {
+    char* option = commandStart + sizeof("QTBuffer");
+
+    if (strncmp(option, "circular:", strlen("circular:")) == 0) {
+        gdbSetTraceCircular(option[strlen("circular:")] == '1');
+        return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+    }
+
+    return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
+}
+
+enum GDBError gdbHandleQTFrame(char* commandStart, char *packetEnd) {
+    int frame = gdbFindTraceFrame(commandStart + sizeof("QTFrame"), packetEnd);
+
+    if (frame == GDB_NO_TRACE_FRAME) {
+        return gdbSendMessage(GDBDataTypeGDB, "$F-1#a4", strlen("$F-1#a4"));
+    }
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyChar(&reply, 'F');
+    gdbReplyHexValue(&reply, frame);
+    gdbReplyChar(&reply, 'T');
+    gdbReplyHexValue(&reply, gdbTraceFrameTracepoint());
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbHandleQTStatus(char* commandStart, char *packetEnd) {
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyTraceStatus(&reply);
+    return gdbReplySend(&reply);
+}
+
+/**
+ * qTBuffer:offset,len downloads the raw trace buffer for tsave
+ */
+enum GDBError gdbHandleQTBufferRead(char* commandStart, char *packetEnd) {
+    u32 offset;
+    u32 len;
+
+    if (!gdbParseAddressLength(commandStart + sizeof("qTBuffer"), packetEnd, &offset, &len)) {
+        return GDBErrorBadPacket;
+    }
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyTraceBuffer(&reply, offset, len);
+    return gdbReplySend(&reply);
+}
+
+// the next tracepoint sent by qTsP
+static int gdbTracepointIndex;
+
+enum GDBError gdbHandleQTsP(char* commandStart, char *packetEnd) {
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+
+    if (gdbReplyTracepoint(&reply, gdbTracepointIndex)) {
+        ++gdbTracepointIndex;
+    } else {
+        gdbReplyChar(&reply, 'l');
+    }
+
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbHandleQTfP(char* commandStart, char *packetEnd) {
+    gdbTracepointIndex = 0;
+    return gdbHandleQTsP(commandStart, packetEnd);
+}
+
+/**
+ * Trace state variables aren't supported so the list is always empty
+ */
+enum GDBError gdbHandleQTfV(char* commandStart, char *packetEnd) {
+    return gdbSendMessage(GDBDataTypeGDB, "$l#6c", strlen("$l#6c"));
+}
+
+enum GDBError gdbHandleQTsV(char* commandStart, char *packetEnd) {
+    return gdbSendMessage(GDBDataTypeGDB, "$l#6c", strlen("$l#6c"));
+}
+
+char* gdbAppendMemoryRegion(char* target, const char* type, u32 start, u32 length) {
+    strcpy(target, "<memory type=\"");
+    target += strlen(target);
+    strcpy(target, type);
+    target += strlen(target);
+    // gdb sign extends 32 bit mips addresses
+    strcpy(target, (start & 0x80000000) ? "\" start=\"0xffffffff" : "\" start=\"0x");
+    target = gdbFormatHex(target + strlen(target), start);
+    strcpy(target, "\" length=\"0x");
+    target = gdbFormatHex(target + strlen(target), length);
+    strcpy(target, "\"/>");
+    return target + strlen(target);
+}
+
+/**
+ * Describes which addresses can be read so gdb doesn't probe 
+ * invalid memory. Code is marked ram since gdb only uses software
+ * breakpoints in ram and refuses to write to rom. gdb refuses any
+ * address outside the map so the tlb mapped segments are listed 
+ * even though only the mapped pages can be read
+ */
+char* gdbBuildMemoryMap() {
+    if (gdbMemoryMapLength) {
+        return gdbMemoryMap;
+    }
+
+    char* current = gdbMemoryMap;
+    strcpy(current, 
+        "<?xml version=\"1.0\"?>"
+        "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">"
+        "<memory-map>"
+    );
+    current += strlen(current);
+    current = gdbAppendMemoryRegion(current, "ram", KUBASE, KUSIZE);
+    current = gdbAppendMemoryRegion(current, "ram", K0BASE, osMemSize);
+    current = gdbAppendMemoryRegion(current, "ram", K1BASE, osMemSize);
+    current = gdbAppendMemoryRegion(current, "ram", GDB_MMIO_START, GDB_MMIO_SIZE);
+    current = gdbAppendMemoryRegion(current, "rom", GDB_CART_START, GDB_CART_END - GDB_CART_START);
+    current = gdbAppendMemoryRegion(current, "ram", K2BASE, GDB_K2_SIZE);
+    strcpy(current, "</memory-map>");
+    current += strlen(current);
+
+    gdbMemoryMapLength = current - gdbMemoryMap;
+    return gdbMemoryMap;
+}
+
+/**
+ * Replies to a qXfer read with the requested part of document
+ * @param offsetStart the offset,length part of the packet
+ */
+enum GDBError gdbReplyXfer(const char* document, u32 documentLen, char* offsetStart, char* packetEnd) {
+    u32 offset;
+    u32 len;
+
+    if (!gdbParseAddressLength(offsetStart, packetEnd, &offset, &len)) {
+        return GDBErrorBadPacket;
+    }
+
+    if (offset > documentLen) {
+        offset = documentLen;
+    }
+
+    if (len > documentLen - offset) {
+        len = documentLen - offset;
+    }
+
+    struct GDBReply reply;
+    gdbReplyStart(&reply, gdbOutputBuffer, MAX_PACKET_SIZE, '$');
+    gdbReplyChar(&reply, offset + len < documentLen ? 'm' : 'l');
+    gdbReplyBinary(&reply, (const u8*)document + offset, len);
+    return gdbReplySend(&reply);
+}
+
+enum GDBError gdbHandleQXfer(char* commandStart, char *packetEnd) {
+    char* object = commandStart + sizeof("qXfer");
+
+    if (strncmp(object, "memory-map:read::", strlen("memory-map:read::")) == 0) {
+        char* document = gdbBuildMemoryMap();
+        return gdbReplyXfer(document, gdbMemoryMapLength, object + strlen("memory-map:read::"), packetEnd);
+    } else if (strncmp(object, "features:read:target.xml:", strlen("features:read:target.xml:")) == 0) {
+        return gdbReplyXfer(gdbTargetXml, gdbTargetXmlLength, object + strlen("features:read:target.xml:"), packetEnd);
     }
 
     return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
 }
 
+/**
+ * Finds the vCont action that applies to thread. Actions are
+ * separated by ';' and the leftmost action matching the thread is used
+ * @returns the start of the action or NULL if no action applies
+ */
+char* gdbFindVContAction(OSThread* thread, char* actions, char* packetEnd) {
+    char* current = actions;
+
+    while (current < packetEnd && *current == ';') {
+        char* action = current + 1;
+        char* actionEnd = action;
+
+        while (actionEnd < packetEnd && *actionEnd != ';' && *actionEnd != ':') {
+            ++actionEnd;
+        }
+
+        if (actionEnd >= packetEnd || *actionEnd == ';') {
+            // an action without a thread applies to every thread
+            return action;
+        }
+
+        OSId threadId = gdbParseThreadId(actionEnd + 1);
+
+        if (threadId == GDB_ALL_THREADS || threadId == osGetThreadId(thread)) {
+            return action;
+        }
+
+        current = actionEnd + 1;
+        while (current < packetEnd && *current != ';') {
+            ++current;
+        }
+    }
+
+    return NULL;
+}
+
+enum GDBError gdbHandleVCont(char* commandStart, char *packetEnd) {
+    if (commandStart[5] == '?') {
+        return gdbSendMessage(GDBDataTypeGDB, "$c;C;s;S;t;r#79", strlen("$c;C;s;S;t;r#79"));
+    }
+
+    OSThread *thread = NULL;
+    enum GDBError err = GDBErrorNone;
+
+    while ((thread = gdbNextThread(thread, GDB_ALL_THREADS))) {
+        char* action = gdbFindVContAction(thread, commandStart + 5, packetEnd);
+        struct GDBStepState* step = gdbFindStepState(thread);
+
+        if (!action) {
+            continue;
+        }
+
+        if (!step) {
+            err = GDBErrorBadPacket;
+            continue;
+        }
+
+        switch (*action)
+        {
+        case 'C':
+        case 'c':
+        {
+            step->isStepping = 0;
+            if (gdbContinueThread(thread) != GDBErrorNone) err = GDBErrorBadPacket;
+            break;
+        }
+        case 'S':
+        case 's':
+        {
+            step->isStepping = 1;
+            if (gdbStepThread(thread) != GDBErrorNone) err = GDBErrorBadPacket;
+            break;
+        }
+        case 't':
+        {
+            if (!gdbIsThreadStopped(thread) && gdbCanStopThread(thread)) {
+                gdbStopThread(thread);
+                step->isStopRequested = 1;
+                // osStopThread doesn't send an event
+                osSendMesg(&gdbPollMesgQ, (OSMesg)GDBEventStop, OS_MESG_NOBLOCK);
+            }
+            break;
+        }
+        case 'r':
+        {
+            gdbParseAddressLength(action + 1, packetEnd, &step->rangeStart, &step->rangeEnd);
+            step->isStepping = 1;
+            if (gdbStepThread(thread) != GDBErrorNone) err = GDBErrorBadPacket;
+            break;
+        }
+        }
+    }
+
+    if (err != GDBErrorNone) {
+        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+    }
+
+    if (gdbRunFlags & GDB_IS_NON_STOP) {
+        // stops are reported later with %Stop notifications
+        return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+    }
+
+    gdbWaitForStop();
+    return GDBErrorNone;
+}
+
+/**
+ * QNonStop:1 lets threads gdb isn't looking at keep running
+ */
+enum GDBError gdbHandleQNonStop(char* commandStart, char *packetEnd) {
+    if (commandStart + 9 >= packetEnd) {
+        return GDBErrorBadPacket;
+    }
+
+    if (commandStart[9] == '1') {
+        gdbRunFlags |= GDB_IS_NON_STOP;
+    } else {
+        gdbRunFlags &= ~(GDB_IS_NON_STOP | GDB_IS_NOTIFYING);
+    }
+
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+enum GDBError gdbHandleVStopped(char* commandStart, char *packetEnd) {
+    return gdbReplyNextStop();
+}
+
+enum GDBError gdbHandleVKill(char* commandStart, char *packetEnd) {
+    int i;
+    gdbStopTrace();
+    gdbRemoveAllBreakpoints();
+    gdbWatchType = 0;
+    gdbClearWatchPoint();
+    gdbRemoveAllTLBWatches();
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        if (gdbThreadAt(i) && gdbIsThreadStopped(gdbThreadAt(i))) {
+            gdbResumeThread(gdbThreadAt(i));
+        }
+    }
+    gdbCommitBreakpoints();
+    gdbRunFlags &= ~GDB_IS_ATTACHED;
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
+/**
+ * Z2 (write), Z3 (read) and Z4 (access) use the WatchLo register. 
+ * It covers one aligned doubleword so only one watchpoint that 
+ * fits inside 8 aligned bytes can use it. Other watchpoints on 
+ * memory mapped through the TLB use the TLB watch engine
+ */
+enum GDBError gdbHandleWatchpoint(char* commandStart, char *packetEnd) {
+    u32 addr;
+    u32 len;
+    char type = commandStart[1];
+
+    if (!gdbParseAddressLength(commandStart + 3, packetEnd, &addr, &len)) {
+        return GDBErrorBadPacket;
+    }
+
+    if (!len) {
+        len = 1;
+    }
+
+    if (*commandStart == 'z') {
+        if (type == gdbWatchType && addr == gdbWatchAddr) {
+            gdbWatchType = 0;
+            gdbClearWatchPoint();
+        } else {
+            gdbRemoveTLBWatch(addr, len, type);
+        }
+
+        return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+    }
+
+    if ((gdbWatchType && (type != gdbWatchType || addr != gdbWatchAddr)) ||
+        (addr & ~(GDB_WATCH_ALIGN - 1)) != ((addr + len - 1) & ~(GDB_WATCH_ALIGN - 1))) {
+        // WatchLo can't hold it but mapped memory can use the TLB
+        if (gdbInsertTLBWatch(addr, len, type)) {
+            return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+        }
+
+        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+    }
+
+    gdbWatchType = type;
+    gdbWatchAddr = addr;
+    gdbWatchLength = len;
+    gdbSetWatchPoint((void*)addr, type != '2', type != '3');
+
+    return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+}
+
 enum GDBError gdbHandlePacket(char* commandStart, char *packetEnd) {
     switch (*commandStart) {
         case 'q':
-            return gdbHandleQuery(commandStart, packetEnd);
+        case 'Q':
         case 'v':
-            return gdbHandleV(commandStart, packetEnd);
+        {
+            GDBPacketHandler handler = gdbFindNamedPacketHandler(commandStart, packetEnd);
+
+            if (handler) {
+                return handler(commandStart, packetEnd);
+            }
+            break;
+        }
         case 'H':
         {
             OSId threadId;
@@ -734,36 +1677,102 @@ enum GDBError gdbHandlePacket(char* commandStart, char *packetEnd) {
         case '!':
             return gdbSendMessage(GDBDataTypeGDB, "$#00", strlen("$#00"));
         case '?':
+            gdbSyncThreads();
+
+            if (gdbRunFlags & GDB_IS_NON_STOP) {
+                int i;
+
+                // every stopped thread is reported again
+                for (i = 0; i < GDB_MAX_THREADS; ++i) {
+                    if (gdbThreadAt(i) && gdbIsThreadStopped(gdbThreadAt(i))) {
+                        gdbStopStates[i] = GDBStopStatePending;
+                    }
+                }
+
+                gdbRunFlags |= GDB_IS_NOTIFYING;
+                return gdbReplyNextStop();
+            }
+
             return gdbSendStopReply(gdbFindThread(GDB_ANY_THREAD));
         case 'g':
             return gdbReplyRegisters();
         case 'G':
             return gdbWriteRegisters(commandStart, packetEnd);
+        case 'p':
+            return gdbReplySingleRegister(commandStart, packetEnd);
+        case 'P':
+            return gdbWriteSingleRegister(commandStart, packetEnd);
         case 'm':
+        case 'x':
             return gdbReplyMemory(commandStart, packetEnd);
         case 'M':
+        case 'X':
             return gdbWriteMemory(commandStart, packetEnd);
         case 'D':
+            // gdb removes its breakpoints before detaching
+            gdbCommitBreakpoints();
             gdbRunFlags &= ~GDB_IS_ATTACHED;
             return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
         case 'z':
         case 'Z':
         {
             if (commandStart[1] == '0') {
-                u32 addr = gdbParseHex(&commandStart[3], 4);
+                u32 addr = gdbParseAddress(&commandStart[3]);
 
                 if (*commandStart == 'z') {
-                    gdbRemoveBreakpoint(gdbFindBreakpoint(addr));
+                    struct GDBBreakpoint* brk = gdbFindBreakpoint(addr);
+
+                    if (brk && gdbIsTracepoint(addr)) {
+                        // the trap stays for the tracepoint
+                        brk->type = GDBBreakpointTypeTracepoint;
+                    } else {
+                        gdbRemoveBreakpoint(brk);
+                    }
+
+                    gdbClearConditions(addr);
+                    gdbClearCommands(addr);
                 } else {
+                    // conditions come after the breakpoint kind
+                    char* conditions = commandStart + 3;
+                    while (conditions < packetEnd && *conditions != ';') {
+                        ++conditions;
+                    }
+
+                    char* commands = conditions;
+                    while (commands < packetEnd && strncmp(commands, ";cmds:", strlen(";cmds:")) != 0) {
+                        ++commands;
+                    }
+
+                    // gdb can insert the same breakpoint again to change its
+                    // conditions. A bad packet leaves the old ones in place
+                    if (gdbParseConditions(conditions, packetEnd) != GDBErrorNone ||
+                        gdbParseCommands(commands, packetEnd) != GDBErrorNone) {
+                        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
+                    }
+
+                    struct GDBBreakpoint* existing = gdbFindBreakpoint(addr);
+                    u8 prevType = existing ? existing->type : GDBBreakpointTypeNone;
                     struct GDBBreakpoint* brk = gdbInsertBreakPoint(addr, GDBBreakpointTypeUser);
 
                     if (!brk) {
-                        strcpy(gdbOutputBuffer, "$E00#");
-                        return gdbSendMessage(GDBDataTypeGDB, gdbOutputBuffer, gdbApplyChecksum(gdbOutputBuffer));
+                        return gdbSendMessage(GDBDataTypeGDB, "$E00#a5", strlen("$E00#a5"));
+                    }
+
+                    if (gdbStoreParsedExpressions(addr) != GDBErrorNone) {
+                        // only remove what this packet inserted
+                        if (existing) {
+                            brk->type = prevType;
+                        } else {
+                            gdbRemoveBreakpoint(brk);
+                        }
+
+                        return gdbSendMessage(GDBDataTypeGDB, "$E01#a6", strlen("$E01#a6"));
                     }
                 }
 
                 return gdbSendMessage(GDBDataTypeGDB, "$OK#9a", strlen("$OK#9a"));
+            } else if (commandStart[1] >= '2' && commandStart[1] <= '4') {
+                return gdbHandleWatchpoint(commandStart, packetEnd);
             } else {
                 break;
             }
@@ -782,9 +1791,18 @@ enum GDBError gdbCheckForPacket() {
         u32 len;
         enum GDBError err = gdbPollHeader(&type, &len);
         if (err != GDBErrorNone) return err;
+        u32 packetLen = len;
+        if (len >= MAX_PACKET_SIZE) {
+            len = MAX_PACKET_SIZE - 1;
+        }
         gdbPacketBuffer[len] = '\0';
         err = gdbReadData(gdbPacketBuffer, len, &len);
         if (err != GDBErrorNone) return err;
+
+        if (type == GDBDataTypeGDB && len < packetLen) {
+            return gdbHandleLongPacket(len);
+        }
+
         err = gdbFinishRead();
         if (err != GDBErrorNone) return err;
 
@@ -793,8 +1811,8 @@ enum GDBError gdbCheckForPacket() {
                 if (gdbRunFlags & GDB_IS_WAITING_STOP) {
                     OSThread* targetThread = gdbFindThread(GDB_ANY_THREAD);
 
-                    if (targetThread) {
-                        osStopThread(targetThread);
+                    if (targetThread && gdbCanStopThread(targetThread)) {
+                        gdbStopThread(targetThread);
                         gdbRunFlags &= ~GDB_IS_WAITING_STOP;
                         gdbSendStopReply(targetThread);
                     }
@@ -825,43 +1843,118 @@ void gdbErrorHandler(s16 code, s16 numArgs, ...) {
     );
 }
 
-void gdbDebuggerLoop(void *arg) {
+/**
+ * Queues stops from threads that stopped since the last poll. Only 
+ * the first stop is sent as a notification, gdb reads the rest with 
+ * vStopped. The other threads keep running the whole time
+ */
+void gdbPollNonStop() {
+    int i;
+
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        OSThread* thread = gdbThreadAt(i);
+
+        if (thread && gdbStopStates[i] == GDBStopStateRunning && gdbIsThreadStopped(thread)) {
+            if (gdbContinueInternalStep(thread)) {
+                continue;
+            }
+
+            gdbStopStates[i] = GDBStopStatePending;
+        }
+    }
+
+    if (gdbRunFlags & GDB_IS_NOTIFYING) {
+        return;
+    }
+
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        if (gdbThreadAt(i) && gdbStopStates[i] == GDBStopStatePending) {
+            gdbRunFlags |= GDB_IS_NOTIFYING;
+            gdbSendStop(gdbThreadAt(i), '%');
+            return;
+        }
+    }
+}
+
+/**
+ * Blocks until a thread faults or the poll timer fires. The
+ * timer only matters for packets from the host since there is 
+ * no interrupt for USB data. Every GDB_POLL_DELAY of quick polls
+ * is reported as one GDBEventPoll
+ */
+enum GDBEvent gdbWaitForEvent() {
     OSMesg msg;
-    osCreateMesgQueue(&gdbPollMesgQ, &gdbPollMesgQMessage, 1);
 
-    // give time for the main thead to hit the starting breakpiont
-    osSetTimer(&gdbPollTimer, GDB_POLL_DELAY, 0, &gdbPollMesgQ, NULL);
+    if (!gdbIsPollTimerSet) {
+        gdbIsPollTimerSet = 1;
+        gdbIsQuickPoll = (gdbRunFlags & GDB_IS_NON_STOP) != 0;
+        osSetTimer(&gdbPollTimer, gdbIsQuickPoll ? GDB_QUICK_POLL_DELAY : GDB_POLL_DELAY, 0, &gdbPollMesgQ, (OSMesg)GDBEventPoll);
+    }
+
     osRecvMesg(&gdbPollMesgQ, &msg, OS_MESG_BLOCK);
 
+    if ((enum GDBEvent)msg == GDBEventPoll) {
+        gdbIsPollTimerSet = 0;
+
+        if (gdbIsQuickPoll && ++gdbQuickPollCount < GDB_QUICK_POLLS_PER_POLL) {
+            return GDBEventQuickPoll;
+        }
+
+        gdbQuickPollCount = 0;
+    }
+
+    return (enum GDBEvent)msg;
+}
+
+void gdbDebuggerLoop(void *arg) {
+    osCreateMesgQueue(&gdbPollMesgQ, gdbPollMesgQMessages, GDB_EVENT_QUEUE_SIZE);
+    // breakpoints and steps wake the debugger as soon as they are hit
+    osSetEventMesg(OS_EVENT_FAULT, &gdbPollMesgQ, (OSMesg)GDBEventFault);
+    osSetEventMesg(OS_EVENT_CPU_BREAK, &gdbPollMesgQ, (OSMesg)GDBEventFault);
+    gdbSetProfileFlushQueue(&gdbPollMesgQ, (OSMesg)GDBEventProfile);
+    gdbSetZoneFlushQueue(&gdbPollMesgQ, (OSMesg)GDBEventZones);
+
+    // give time for the main thead to hit the starting breakpiont
+    gdbWaitForEvent();
+
     gdbRunFlags |= GDB_IS_ATTACHED;
-    while (gdbRunFlags & GDB_IS_ATTACHED) {
+    // profile samples and zones keep streaming after gdb detaches
+    while ((gdbRunFlags & GDB_IS_ATTACHED) || gdbIsProfiling() || gdbIsRecordingZones()) {
 
         while (gdbCheckForPacket() == GDBErrorNone);
 
-        if (gdbRunFlags & GDB_IS_WAITING_STOP) {
-            osSetTimer(&gdbPollTimer, gdbQuickPollCount ? GDB_QUICK_POLL_DELAY : GDB_POLL_DELAY, 0, &gdbPollMesgQ, NULL);
-
-            if (gdbQuickPollCount > 0) {
-                --gdbQuickPollCount;
-            }
+        gdbFlushProfile();
+        gdbFlushZones();
 
+        if (!(gdbRunFlags & GDB_IS_ATTACHED)) {
+            gdbWaitForEvent();
+        } else if (gdbRunFlags & (GDB_IS_WAITING_STOP | GDB_IS_NON_STOP)) {
             int i;
-            // while program is running, decrease polling rate
-            osRecvMesg(&gdbPollMesgQ, &msg, OS_MESG_BLOCK);
+            enum GDBEvent event = gdbWaitForEvent();
 
-            if (gdbHangCheck > GDBHangCheckUnhealthy && gdbQuickPollCount == 0) {
+            if (event == GDBEventPoll && gdbHangCheck > GDBHangCheckUnhealthy) {
                 --gdbHangCheck;
-            } else if (gdbHangCheck == GDBHangCheckUnhealthy && gdbTargetThreads[0]) {
-                osStopThread(gdbTargetThreads[0]);
+            } else if (gdbHangCheck == GDBHangCheckUnhealthy && gdbThreadIndex(gdbHeartbeatThread) != -1) {
+                gdbStopThread(gdbHeartbeatThread);
                 gdbHangCheck = GDBHangCheckNone;
             }
 
-            for (i = 0; i < MAX_DEBUGGER_THREADS; ++i) {
-                if (gdbTargetThreads[i] && (gdbTargetThreads[i]->flags & OS_FLAG_FAULT ||
-                    gdbTargetThreads[i]->state == OS_STATE_STOPPED)) {
-                    gdbRunFlags &= ~GDB_IS_WAITING_STOP;
-                    gdbSendStopReply(gdbTargetThreads[i]);
-                    break;
+            // threads can be created or destroyed while the game runs
+            gdbSyncThreads();
+
+            if (gdbRunFlags & GDB_IS_NON_STOP) {
+                gdbPollNonStop();
+            } else {
+                for (i = 0; i < GDB_MAX_THREADS; ++i) {
+                    if (gdbThreadAt(i) && gdbIsThreadStopped(gdbThreadAt(i))) {
+                        if (gdbContinueInternalStep(gdbThreadAt(i))) {
+                            continue;
+                        }
+
+                        gdbRunFlags &= ~GDB_IS_WAITING_STOP;
+                        gdbSendStopReply(gdbThreadAt(i));
+                        break;
+                    }
                 }
             }
         }
@@ -879,19 +1972,18 @@ enum GDBError gdbInitDebugger(OSPiHandle* handler, OSMesgQueue* dmaMessageQ, OST
     if (err != GDBErrorNone) return err;
 
     OSThread* primaryThread = NULL;
-    OSId currThread = osGetThreadId(NULL);
 
     int i;
-    for (i = 0; i < forThreadsLen && i < MAX_DEBUGGER_THREADS; ++i) {
-        gdbTargetThreads[i] = forThreads[i];
-
-        if (osGetThreadId(forThreads[i]) == currThread) {
-            primaryThread = forThreads[i];
-        }
+    for (i = 0; i < forThreadsLen; ++i) {
+        gdbIncludeThread(osGetThreadId(forThreads[i]));
     }
-    
-    for (;i < MAX_DEBUGGER_THREADS; ++i) {
-        gdbTargetThreads[i] = NULL;
+
+    gdbExcludeThread(GDB_DEBUGGER_THREAD_ID);
+    gdbExcludeThread(GDB_PROFILER_THREAD_ID);
+    gdbSyncThreads();
+
+    if (gdbThreadIndex(__osRunningThread) != -1) {
+        primaryThread = __osRunningThread;
     }
 
     osCreateThread(&gdbDebuggerThread, GDB_DEBUGGER_THREAD_ID, gdbDebuggerLoop, NULL, gdbDebuggerThreadStack + GDB_STACKSIZE/sizeof(u64), 13);
@@ -900,7 +1992,7 @@ enum GDBError gdbInitDebugger(OSPiHandle* handler, OSMesgQueue* dmaMessageQ, OST
     // The main thread needs to be paused before interrupts work
     // I'm not sure why
     if (primaryThread != NULL) {
-        osStopThread(primaryThread);
+        gdbStopThread(primaryThread);
         gdbBreak();
     }
     
@@ -913,16 +2005,19 @@ void* getWatchPoint() {
 }
 
 void gdbSetWatchPoint(void* addr, int read, int write) {
-    __gdbSetWatch(((u32)addr & 0x1ffffff8) | (read ? 0x2 : 0) | (write ? 0x1 : 0));
+    gdbWatchValue = ((u32)addr & 0x1ffffff8) | (read ? GDB_WATCH_READ : 0) | (write ? GDB_WATCH_WRITE : 0);
+    __gdbSetWatch(gdbWatchValue);
 }
 
 void gdbClearWatchPoint() {
+    gdbWatchValue = 0;
     __gdbSetWatch(0);
 }
 
 
 void gdbHeartbeat() {
     gdbHangCheck = GDBHangCheckHealthy;
+    gdbHeartbeatThread = __osRunningThread;
 
 }
 
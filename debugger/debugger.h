@@ -5,27 +5,12 @@
 #include <ultra64.h>
 #include "serial.h"
 
-enum GDBBreakpointType {
-    GDBBreakpointTypeNone,
-    GDBBreakpointTypeTemporary,
-    GDBBreakpointTypeUser,
-    GDBBreakpointTypeUserUnapplied,
-};
-
 enum GDBHangCheck {
     GDBHangCheckNone,
     GDBHangCheckUnhealthy,
     GDBHangCheckHealthy = 20
 };
 
-struct GDBBreakpoint {
-    u32 addr;
-    u32 prevValue;
-    enum GDBBreakpointType type; 
-};
-
-#define GDB_MAX_BREAK_POINTS    32
-
 /**
  * Initializes the debugger
  * @param handler Pi Handler used for DMA, this is return value 
@@ -35,10 +20,44 @@ struct GDBBreakpoint {
  *  actions in the rest of your program
  * @param forThreads an array of threads you want the debugger to
  *  watch connect to. If a thread isn't included in this array
- *  it will be ignored by the debugger
+ *  it will be ignored by the debugger. Pass NULL to debug every
+ *  game thread, including threads created later. The idle thread
+ *  and threads above OS_PRIORITY_APPMAX are never stopped
  * @param forThreadsLen the length of the forThreads array
  */
 enum GDBError gdbInitDebugger(OSPiHandle* handler, OSMesgQueue* dmaMessageQ, OSThread** forThreads, u32 forThreadsLen);
+/**
+ * Threads are found while the game runs so these can be called at
+ * any time. Once any id is included only threads with an included 
+ * id are debugged. Excluded ids are never debugged
+ */
+void gdbIncludeThread(OSId id);
+void gdbExcludeThread(OSId id);
+
+/**
+ * Samples which thread and pc the game is running samplesPerSecond 
+ * times a second. The samples are sent to proxy.js while the debugger 
+ * thread runs, including after gdb detaches. Calling this again 
+ * changes the rate
+ */
+void gdbStartProfiler(u32 samplesPerSecond);
+void gdbStopProfiler();
+
+/**
+ * Zones and counters are recorded with the cpu counter into a buffer
+ * for each thread and sent to proxy.js while the debugger thread runs.
+ * proxy.js writes them as a trace Chrome and Perfetto can show. They
+ * do nothing until gdbStartZones is called and can be left in hot code
+ */
+void gdbStartZones();
+void gdbStopZones();
+/**
+ * Zones on the same thread must nest. gdbZoneEnd ends the most
+ * recent zone the thread began
+ */
+void gdbZoneBegin(u32 id);
+void gdbZoneEnd();
+void gdbCounter(u32 id, u32 value);
 enum GDBError gdbCheckForPacket();
 
 /**
@@ -64,4 +83,15 @@ void gdbSetWatchPoint(void* addr, int read, int write);
 void gdbClearWatchPoint();
 void gdbHeartbeat();
 
+/**
+ * Converts an address from gdb to one the debugger can read from. 
+ * Returns 0 if the address isn't valid
+ */
+void* gdbTranslateAddr(void* in);
+/**
+ * Limits len so a read starting at translated doesn't run
+ * off the end of the memory region it starts in
+ */
+u32 gdbReadableLength(void* translated, u32 len);
+
 #endif
\ No newline at end of file
@@ -4,6 +4,16 @@ enum GDBError gdbInitDebugger(OSPiHandle* handler, OSMesgQueue* dmaMessageQ, OST
     return GDBErrorNone;
 }
 
+void gdbIncludeThread(OSId id) {}
+void gdbExcludeThread(OSId id) {}
+void gdbStartProfiler(u32 samplesPerSecond) {}
+void gdbStopProfiler() {}
+void gdbStartZones() {}
+void gdbStopZones() {}
+void gdbZoneBegin(u32 id) {}
+void gdbZoneEnd() {}
+void gdbCounter(u32 id, u32 value) {}
+
 enum GDBError gdbCheckForPacket() {
     return GDBErrorNone;
 }
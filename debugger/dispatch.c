@@ -0,0 +1,110 @@
+#include "dispatch.h"
+#include <string.h>
+
+#define GDB_DECLARE_PACKET_HANDLER(name, handler) enum GDBError handler(char* commandStart, char* packetEnd);
+#define GDB_PACKET_COMMAND(name, handler) {name, handler},
+#define GDB_PACKET_COUNT(commands) (sizeof(commands) / sizeof(*(commands)))
+
+GDB_NAMED_PACKETS(GDB_DECLARE_PACKET_HANDLER)
+
+static const struct GDBPacketCommand gdbSetPackets[] = {
+    GDB_SET_PACKETS(GDB_PACKET_COMMAND)
+};
+
+static const struct GDBPacketCommand gdbQueryPackets[] = {
+    GDB_QUERY_PACKETS(GDB_PACKET_COMMAND)
+};
+
+static const struct GDBPacketCommand gdbVPackets[] = {
+    GDB_V_PACKETS(GDB_PACKET_COMMAND)
+};
+
+
+/**
+ * Packet names are letters and digits. Anything else, such as
+ * ':', ';', ',', '?' or '#', ends the name
+ */
+static inline int gdbIsPacketNameChar(char chr) {
+    return (u8)((chr | 0x20) - 'a') < 26 || (u8)(chr - '0') < 10;
+}
+
+/**
+ * Compares a table name against the name at the start of a packet.
+ * The packet name ends at the first character that can't be in a name
+ * or at packetEnd. Since table names only hold name characters that 
+ * is only checked where the names differ
+ */
+static int gdbComparePacketName(const char* name, const char* packetName, const char* packetEnd) {
+    while (*name) {
+        if (packetName == packetEnd) {
+            return 1;
+        }
+
+        int diff = (u8)*name - (u8)*packetName;
+
+        if (diff != 0) {
+            // a longer table name sorts after the packet name
+            return gdbIsPacketNameChar(*packetName) ? diff : 1;
+        }
+
+        ++name;
+        ++packetName;
+    }
+
+    // a longer packet name sorts after the table name
+    return packetName != packetEnd && gdbIsPacketNameChar(*packetName) ? -1 : 0;
+}
+
+/**
+ * Checks if the packet name ends at nameEnd
+ */
+static inline int gdbIsPacketNameEnd(const char* nameEnd, const char* packetEnd) {
+    return nameEnd == packetEnd || !gdbIsPacketNameChar(*nameEnd);
+}
+
+/**
+ * The names are string literals so the memcmp has a constant length
+ * the compiler can expand inline. The packet is at least one letter
+ * followed by '#' so the first two characters can always be read
+ * and the length check keeps memcmp from reading past packetEnd
+ */
+#define GDB_MATCH_HOT_PACKET(name, handler) \
+    if (commandStart[0] == name[0] && commandStart[1] == name[1] && (u32)(packetEnd - commandStart) >= sizeof(name) - 1 && \
+        memcmp(commandStart + 2, name + 2, sizeof(name) - 3) == 0 && gdbIsPacketNameEnd(commandStart + sizeof(name) - 1, packetEnd)) { \
+        return handler; \
+    }
+
+GDBPacketHandler gdbFindPacketHandler(const struct GDBPacketCommand* commands, int count, char* commandStart, char* packetEnd) {
+    int min = 0;
+    int max = count;
+
+    while (min < max) {
+        int mid = (min + max) >> 1;
+        int compare = gdbComparePacketName(commands[mid].name, commandStart, packetEnd);
+
+        if (compare == 0) {
+            return commands[mid].handler;
+        } else if (compare < 0) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+
+    return NULL;
+}
+
+GDBPacketHandler gdbFindNamedPacketHandler(char* commandStart, char* packetEnd) {
+    GDB_HOT_PACKETS(GDB_MATCH_HOT_PACKET)
+
+    switch (*commandStart) {
+        case 'Q':
+            return gdbFindPacketHandler(gdbSetPackets, GDB_PACKET_COUNT(gdbSetPackets), commandStart, packetEnd);
+        case 'q':
+            return gdbFindPacketHandler(gdbQueryPackets, GDB_PACKET_COUNT(gdbQueryPackets), commandStart, packetEnd);
+        case 'v':
+            return gdbFindPacketHandler(gdbVPackets, GDB_PACKET_COUNT(gdbVPackets), commandStart, packetEnd);
+    }
+
+    return NULL;
+}
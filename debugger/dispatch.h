@@ -0,0 +1,87 @@
+#ifndef __LIBULTRA_GDB_DISPATCH_H
+#define __LIBULTRA_GDB_DISPATCH_H
+
+#include "serial.h"
+
+typedef enum GDBError (*GDBPacketHandler)(char* commandStart, char* packetEnd);
+
+struct GDBPacketCommand {
+    const char* name;
+    GDBPacketHandler handler;
+};
+
+/**
+ * The named q, Q and v packets handled by debugger.c. New packets
+ * should be registered here instead of checked for one at a time.
+ * There is one list for each first letter so a switch on the first
+ * letter picks the list before the binary search. Each list must stay
+ * sorted by name in strcmp order, uppercase names come before lowercase
+ */
+#define GDB_SET_PACKETS(PACKET) \
+    PACKET("QN64BreakIgnore", gdbHandleQN64BreakIgnore) \
+    PACKET("QN64Profile", gdbHandleQN64Profile) \
+    PACKET("QN64Zones", gdbHandleQN64Zones) \
+    PACKET("QNonStop", gdbHandleQNonStop) \
+    PACKET("QTBuffer", gdbHandleQTBuffer) \
+    PACKET("QTDP", gdbHandleQTDP) \
+    PACKET("QTFrame", gdbHandleQTFrame) \
+    PACKET("QTStart", gdbHandleQTStart) \
+    PACKET("QTStop", gdbHandleQTStop) \
+    PACKET("QTinit", gdbHandleQTinit) \
+
+#define GDB_QUERY_PACKETS(PACKET) \
+    PACKET("qAttached", gdbHandleQAttached) \
+    PACKET("qC", gdbHandleQC) \
+    PACKET("qN64BreakHits", gdbHandleQN64BreakHits) \
+    PACKET("qOffsets", gdbHandleQOffsets) \
+    PACKET("qSupported", gdbHandleQSupported) \
+    PACKET("qSymbol", gdbHandleQSymbol) \
+    PACKET("qTBuffer", gdbHandleQTBufferRead) \
+    PACKET("qTStatus", gdbHandleQTStatus) \
+    PACKET("qTfP", gdbHandleQTfP) \
+    PACKET("qTfV", gdbHandleQTfV) \
+    PACKET("qThreadExtraInfo", gdbHandleQThreadExtraInfo) \
+    PACKET("qTsP", gdbHandleQTsP) \
+    PACKET("qTsV", gdbHandleQTsV) \
+    PACKET("qXfer", gdbHandleQXfer) \
+    PACKET("qfThreadInfo", gdbHandleQfThreadInfo) \
+    PACKET("qsThreadInfo", gdbHandleQsThreadInfo) \
+
+#define GDB_V_PACKETS(PACKET) \
+    PACKET("vCont", gdbHandleVCont) \
+    PACKET("vKill", gdbHandleVKill) \
+    PACKET("vStopped", gdbHandleVStopped) \
+
+/**
+ * Packets gdb sends the most, checked in order before the binary
+ * search. vCont resumes the program, qTStatus is polled while tracing,
+ * the thread list is read after each stop and qSupported starts every
+ * connection. Each must also be in its list
+ */
+#define GDB_HOT_PACKETS(PACKET) \
+    PACKET("vCont", gdbHandleVCont) \
+    PACKET("qTStatus", gdbHandleQTStatus) \
+    PACKET("qfThreadInfo", gdbHandleQfThreadInfo) \
+    PACKET("qsThreadInfo", gdbHandleQsThreadInfo) \
+    PACKET("qSupported", gdbHandleQSupported) \
+
+#define GDB_NAMED_PACKETS(PACKET) \
+    GDB_SET_PACKETS(PACKET) \
+    GDB_QUERY_PACKETS(PACKET) \
+    GDB_V_PACKETS(PACKET) \
+
+/**
+ * Finds the handler for a packet. The packet name ends at the first
+ * ':', ';', ',', '?' or '#' so "vCont;c" and "vCont?" both match "vCont"
+ * @param commands a table sorted by name
+ * @param count the number of entries in commands
+ * @returns the handler or NULL if the packet isn't in the table
+ */
+GDBPacketHandler gdbFindPacketHandler(const struct GDBPacketCommand* commands, int count, char* commandStart, char* packetEnd);
+/**
+ * Finds the handler for a packet in GDB_NAMED_PACKETS
+ * @returns NULL if the packet isn't named or isn't in the lists
+ */
+GDBPacketHandler gdbFindNamedPacketHandler(char* commandStart, char* packetEnd);
+
+#endif
@@ -0,0 +1,139 @@
+#include "hex.h"
+
+#define GDB_HEX_ROW(high) \
+    {high, '0'}, {high, '1'}, {high, '2'}, {high, '3'}, \
+    {high, '4'}, {high, '5'}, {high, '6'}, {high, '7'}, \
+    {high, '8'}, {high, '9'}, {high, 'a'}, {high, 'b'}, \
+    {high, 'c'}, {high, 'd'}, {high, 'e'}, {high, 'f'},
+
+const char gdbHexEncodeTable[256][2] = {
+    GDB_HEX_ROW('0') GDB_HEX_ROW('1') GDB_HEX_ROW('2') GDB_HEX_ROW('3')
+    GDB_HEX_ROW('4') GDB_HEX_ROW('5') GDB_HEX_ROW('6') GDB_HEX_ROW('7')
+    GDB_HEX_ROW('8') GDB_HEX_ROW('9') GDB_HEX_ROW('a') GDB_HEX_ROW('b')
+    GDB_HEX_ROW('c') GDB_HEX_ROW('d') GDB_HEX_ROW('e') GDB_HEX_ROW('f')
+};
+
+const u8 gdbHexDecodeTable[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+#define GDB_EACH_BYTE(value)    (0x01010101u * (value))
+// sets the high bit of each byte in [low, high]. Only valid 
+// when the high bit of every byte in word is clear
+#define GDB_BYTES_IN_RANGE(word, low, high) \
+    (((word) + GDB_EACH_BYTE(0x80 - (low))) & ~((word) + GDB_EACH_BYTE(0x7F - (high))))
+
+#define GDB_LOAD_WORD(src) \
+    (((u32)(u8)(src)[0] << 24) | ((u32)(u8)(src)[1] << 16) | ((u32)(u8)(src)[2] << 8) | (u32)(u8)(src)[3])
+
+s32 gdbDecodeHexWord(u32 characters) {
+    u32 isDigit = GDB_BYTES_IN_RANGE(characters, '0', '9');
+    // setting 0x20 maps 'A'-'F' onto 'a'-'f'
+    u32 isLetter = GDB_BYTES_IN_RANGE(characters | GDB_EACH_BYTE(0x20), 'a', 'f');
+    u32 isValid = (isDigit | isLetter) & ~characters & GDB_EACH_BYTE(0x80);
+
+    // '0'-'9' have 0 in bit 6 and 'a'-'f' need 9 added to the low nibble
+    u32 nibbles = (characters & GDB_EACH_BYTE(0x0F)) + 9 * ((characters >> 6) & GDB_EACH_BYTE(0x01));
+    // combine the nibble pairs into the 2nd and 4th bytes
+    nibbles |= nibbles >> 4;
+    s32 result = ((nibbles >> 8) & 0xFF00) | (nibbles & 0xFF);
+
+    // -1 unless every byte was valid
+    return result | -(s32)(isValid != GDB_EACH_BYTE(0x80));
+}
+
+u32 gdbParseHex(char* src, u32 maxBytes) {
+    u32 result = 0;
+    u32 maxCharacters = maxBytes * 2;
+
+    while (maxCharacters >= 4) {
+        s32 value = gdbDecodeHexWord(GDB_LOAD_WORD(src));
+
+        if (value < 0) {
+            break;
+        }
+
+        result = (result << 16) | value;
+        src += 4;
+        maxCharacters -= 4;
+    }
+
+    while (maxCharacters > 0) {
+        int digit = gdbReadHexDigit(*src);
+
+        if (digit == -1) {
+            break;
+        }
+
+        result = (result << 4) + digit;
+        ++src;
+        --maxCharacters;
+    }
+
+    return result;
+}
+
+u32 gdbParseAddress(char* src) {
+    char* end = src;
+
+    while (gdbReadHexDigit(*end) != -1) {
+        ++end;
+    }
+
+    if (end - src > sizeof(u32) * 2) {
+        src = end - sizeof(u32) * 2;
+    }
+
+    return gdbParseHex(src, sizeof(u32));
+}
+
+char* gdbWriteHex(char* target, u8* src, u32 bytes) {
+    while (bytes > 0) {
+        const char* pair = gdbHexEncodeTable[*src];
+        target[0] = pair[0];
+        target[1] = pair[1];
+        target += 2;
+        ++src;
+        --bytes;
+    }
+    return target;
+}
+
+char* gdbReadHex(u8* target, char* src, u32 maxBytes) {
+    while (maxBytes >= 2) {
+        s32 value = gdbDecodeHexWord(GDB_LOAD_WORD(src));
+
+        if (value < 0) {
+            break;
+        }
+
+        target[0] = (u8)(value >> 8);
+        target[1] = (u8)value;
+        target += 2;
+        src += 4;
+        maxBytes -= 2;
+    }
+
+    while (maxBytes > 0) {
+        int firstDigit = gdbReadHexDigit(*src++);
+
+        if (firstDigit == -1) {
+            return src;
+        } 
+
+        int secondDigit = gdbReadHexDigit(*src++);
+
+        if (secondDigit == -1) {
+            *target++ = firstDigit << 4;
+            return src;
+        }
+
+        *target++ = (firstDigit << 4) | secondDigit;
+        --maxBytes;
+    }
+
+    return src;
+}
@@ -0,0 +1,48 @@
+#ifndef __LIBULTRA_GDB_HEX_H
+#define __LIBULTRA_GDB_HEX_H
+
+#include <ultra64.h>
+
+/**
+ * Two lowercase hex characters for every byte value
+ */
+extern const char gdbHexEncodeTable[256][2];
+/**
+ * The value + 1 of every hex character, 0 for anything else
+ */
+extern const u8 gdbHexDecodeTable[256];
+
+/**
+ * Returns the value of a hex character or -1 if it isn't hex
+ */
+static inline int gdbReadHexDigit(char character) {
+    return gdbHexDecodeTable[(u8)character] - 1;
+}
+
+/**
+ * Decodes 4 hex characters packed big endian into a word
+ * without branching. Returns -1 if any of them aren't hex
+ */
+s32 gdbDecodeHexWord(u32 characters);
+
+/**
+ * Parses up to maxBytes * 2 hex characters stopping at the first 
+ * character that isn't hex
+ */
+u32 gdbParseHex(char* src, u32 maxBytes);
+/**
+ * Parses an address gdb may have sign extended to 64 bits
+ * by keeping the low 32 bits
+ */
+u32 gdbParseAddress(char* src);
+/**
+ * Writes bytes * 2 hex characters and returns the end of the output
+ */
+char* gdbWriteHex(char* target, u8* src, u32 bytes);
+/**
+ * Reads up to maxBytes from hex stopping at the first character 
+ * that isn't hex. Returns the end of the input
+ */
+char* gdbReadHex(u8* target, char* src, u32 maxBytes);
+
+#endif
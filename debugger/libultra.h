@@ -0,0 +1,23 @@
+#ifndef __LIBULTRA_GDB_LIBULTRA_H
+#define __LIBULTRA_GDB_LIBULTRA_H
+
+#include <ultra64.h>
+
+/**
+ * Parts of libultra the debugger uses that ultra64.h doesn't declare
+ */
+
+// __osThreadTail ends the active queue and the run queue
+#define GDB_THREAD_TAIL_PRIORITY    -1
+
+extern OSThread* __osRunningThread;
+extern OSThread* __osActiveQueue;
+extern OSThread* __osRunQueue;
+
+extern OSThread* __osGetCurrFaultedThread(void);
+extern OSThread* __osGetNextFaultedThread(OSThread*);
+
+extern u32 __osDisableInt(void);
+extern void __osRestoreInt(u32);
+
+#endif
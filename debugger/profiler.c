@@ -0,0 +1,175 @@
+#include "profiler.h"
+#include "debugger.h"
+#include "unwind.h"
+#include "libultra.h"
+
+// room for gdbTakeSample, gdbUnwindStack and osSendMesg nested under it
+#define GDB_PROFILER_STACKSIZE      0x800
+
+static OSThread gdbProfilerThread;
+static u64 gdbProfilerThreadStack[GDB_PROFILER_STACKSIZE/sizeof(u64)];
+static OSTimer gdbProfilerTimer;
+static OSMesgQueue gdbProfilerMesgQ;
+static OSMesg gdbProfilerMesgQMessage;
+static u8 gdbIsProfilerThreadStarted;
+
+// 0 when the profiler is stopped
+static u32 gdbProfileRate;
+
+#define GDB_PROFILE_WORD(index)     gdbProfileBuffer[(index) & (GDB_PROFILE_BUFFER_SIZE - 1)]
+
+static u32 gdbProfileBuffer[GDB_PROFILE_BUFFER_SIZE];
+// only the profiler thread moves the head and only the debugger thread moves the tail
+static volatile u32 gdbProfileHead;
+static volatile u32 gdbProfileTail;
+static volatile u32 gdbProfileDropped;
+
+static OSMesgQueue* gdbProfileFlushQueue;
+static OSMesg gdbProfileFlushMesg;
+
+static u32 gdbProfileMessage[GDB_PROFILE_MESSAGE_SIZE];
+
+/**
+ * The timer interrupt put the thread it preempted back on the run
+ * queue. Threads are never time sliced so it is the first thread on
+ * the queue unless another thread with the same priority was waiting
+ */
+static void gdbTakeSample() {
+    u32 frames[GDB_PROFILE_MAX_FRAMES + 1];
+    u32 frameCount = 0;
+    u32 pc = 0;
+    OSId threadId = 0;
+
+    u32 saveMask = __osDisableInt();
+    OSThread* thread = __osRunQueue;
+
+    if (thread && thread->priority != GDB_THREAD_TAIL_PRIORITY) {
+        pc = thread->context.pc;
+        threadId = thread->id;
+    } else {
+        thread = NULL;
+    }
+
+    __osRestoreInt(saveMask);
+
+    if (thread) {
+        // the thread can't run until the profiler blocks again
+        frameCount = gdbUnwindStack(thread, frames, GDB_PROFILE_MAX_FRAMES);
+    }
+
+    u32 head = gdbProfileHead;
+    u32 used = head - gdbProfileTail;
+    u32 size = GDB_PROFILE_SAMPLE_HEADER + frameCount;
+
+    if (used + size > GDB_PROFILE_BUFFER_SIZE) {
+        ++gdbProfileDropped;
+        return;
+    }
+
+    GDB_PROFILE_WORD(head) = pc;
+    GDB_PROFILE_WORD(head + 1) = threadId;
+    GDB_PROFILE_WORD(head + 2) = frameCount;
+
+    u32 i;
+    for (i = 0; i < frameCount; ++i) {
+        GDB_PROFILE_WORD(head + GDB_PROFILE_SAMPLE_HEADER + i) = frames[i];
+    }
+
+    gdbProfileHead = head + size;
+
+    if (used < GDB_PROFILE_BUFFER_SIZE / 2 && used + size >= GDB_PROFILE_BUFFER_SIZE / 2 && gdbProfileFlushQueue) {
+        osSendMesg(gdbProfileFlushQueue, gdbProfileFlushMesg, OS_MESG_NOBLOCK);
+    }
+}
+
+static void gdbProfilerLoop(void* arg) {
+    OSMesg msg;
+
+    while (1) {
+        osRecvMesg(&gdbProfilerMesgQ, &msg, OS_MESG_BLOCK);
+
+        if (gdbProfileRate) {
+            gdbTakeSample();
+        }
+    }
+}
+
+void gdbStartProfiler(u32 samplesPerSecond) {
+    gdbStopProfiler();
+
+    if (!samplesPerSecond) {
+        return;
+    }
+
+    if (!gdbIsProfilerThreadStarted) {
+        // a single message so samples the thread misses are dropped instead of queued
+        osCreateMesgQueue(&gdbProfilerMesgQ, &gdbProfilerMesgQMessage, 1);
+        osCreateThread(&gdbProfilerThread, GDB_PROFILER_THREAD_ID, gdbProfilerLoop, NULL, gdbProfilerThreadStack + GDB_PROFILER_STACKSIZE/sizeof(u64), GDB_PROFILER_PRIORITY);
+        osStartThread(&gdbProfilerThread);
+        gdbIsProfilerThreadStarted = 1;
+    }
+
+    OSTime interval = OS_CPU_COUNTER / samplesPerSecond;
+
+    if (!interval) {
+        interval = 1;
+    }
+
+    gdbProfileRate = samplesPerSecond;
+    osSetTimer(&gdbProfilerTimer, interval, interval, &gdbProfilerMesgQ, NULL);
+}
+
+void gdbStopProfiler() {
+    if (gdbProfileRate) {
+        osStopTimer(&gdbProfilerTimer);
+        gdbProfileRate = 0;
+    }
+}
+
+int gdbIsProfiling() {
+    return gdbProfileRate != 0;
+}
+
+void gdbSetProfileFlushQueue(OSMesgQueue* queue, OSMesg msg) {
+    gdbProfileFlushQueue = queue;
+    gdbProfileFlushMesg = msg;
+}
+
+enum GDBError gdbFlushProfile() {
+    // samples taken while sending wait for the next flush
+    u32 head = gdbProfileHead;
+    u32 tail = gdbProfileTail;
+
+    while (head != tail || gdbProfileDropped) {
+        u32 saveMask = __osDisableInt();
+        u32 dropped = gdbProfileDropped;
+        gdbProfileDropped = 0;
+        __osRestoreInt(saveMask);
+
+        gdbProfileMessage[0] = gdbProfileRate;
+        gdbProfileMessage[1] = dropped;
+        u32 length = 2;
+
+        while (tail != head) {
+            u32 size = GDB_PROFILE_SAMPLE_HEADER + GDB_PROFILE_WORD(tail + 2);
+
+            if (length + size > GDB_PROFILE_MESSAGE_SIZE) {
+                break;
+            }
+
+            u32 i;
+            for (i = 0; i < size; ++i) {
+                gdbProfileMessage[length++] = GDB_PROFILE_WORD(tail + i);
+            }
+
+            tail += size;
+        }
+
+        gdbProfileTail = tail;
+
+        enum GDBError err = gdbSendMessage(GDBDataTypeProfile, (char*)gdbProfileMessage, length * sizeof(u32));
+        if (err != GDBErrorNone) return err;
+    }
+
+    return GDBErrorNone;
+}
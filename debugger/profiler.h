@@ -0,0 +1,46 @@
+#ifndef __LIBULTRA_GDB_PROFILER_H
+#define __LIBULTRA_GDB_PROFILER_H
+
+#include <ultra64.h>
+#include "serial.h"
+
+// words of samples held until the debugger thread sends them. Must be a power of 2
+#ifndef GDB_PROFILE_BUFFER_SIZE
+#define GDB_PROFILE_BUFFER_SIZE     0x4000
+#endif
+
+// return addresses unwound for each sample. 0 only records the pc
+#ifndef GDB_PROFILE_MAX_FRAMES
+#define GDB_PROFILE_MAX_FRAMES      8
+#endif
+
+// the profiler has to preempt every game thread to see what it was running
+#ifndef GDB_PROFILER_PRIORITY
+#define GDB_PROFILER_PRIORITY       OS_PRIORITY_APPMAX
+#endif
+
+#define GDB_PROFILER_THREAD_ID      0xDBDC
+// words in each message sent to the host
+#define GDB_PROFILE_MESSAGE_SIZE    0x400
+
+/**
+ * A GDBDataTypeProfile message is a u32 sample rate and a u32 count
+ * of samples dropped since the last message followed by the samples.
+ * Each sample is the pc, the thread id, the number of return addresses
+ * and then the return addresses starting with the innermost caller
+ */
+#define GDB_PROFILE_SAMPLE_HEADER   3
+
+int gdbIsProfiling();
+/**
+ * queue gets msg when the buffer is half full so the debugger
+ * thread can send the samples before any are dropped
+ */
+void gdbSetProfileFlushQueue(OSMesgQueue* queue, OSMesg msg);
+/**
+ * Sends the samples collected so far. Only the debugger thread
+ * should call this since it owns the serial port
+ */
+enum GDBError gdbFlushProfile();
+
+#endif
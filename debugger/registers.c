@@ -0,0 +1,316 @@
+#include "registers.h"
+#include "reply.h"
+#include "hex.h"
+#include "debugger.h"
+#include <stddef.h>
+
+// the VR4300 implementation and revision number
+#define GDB_FIR_VALUE   0x00000B00
+
+enum GDBRegisterType {
+    // always reads as zero and ignores writes
+    GDBRegisterTypeNone,
+    // stored in the thread context at the size gdb expects
+    GDBRegisterTypeContext,
+    // a 32 bit value in the thread context gdb sees as 64 bits
+    GDBRegisterTypeContext32,
+    GDBRegisterTypePC,
+    GDBRegisterTypeFIR,
+};
+
+struct GDBRegisterLocation {
+    u16 offset;
+    u16 type;
+};
+
+#define GDB_NO_REGISTER                 {0, GDBRegisterTypeNone}
+#define GDB_CONTEXT_REGISTER(field)     {offsetof(__OSThreadContext, field), GDBRegisterTypeContext}
+#define GDB_CONTEXT_REGISTER32(field)   {offsetof(__OSThreadContext, field), GDBRegisterTypeContext32}
+// with FR=0 each __OSfp holds an even and odd register pair
+#define GDB_FPU_EVEN_REGISTER(field)    {offsetof(__OSThreadContext, field.f.f_even), GDBRegisterTypeContext}
+#define GDB_FPU_ODD_REGISTER(field)     {offsetof(__OSThreadContext, field.f.f_odd), GDBRegisterTypeContext}
+
+/**
+ * Where each register in the g packet lives in __OSThreadContext
+ * indexed by gdb register number. k0 and k1 aren't saved
+ */
+static const struct GDBRegisterLocation gdbRegisterLocations[GDB_REGISTER_COUNT] = {
+    GDB_NO_REGISTER,
+    GDB_CONTEXT_REGISTER(at),
+    GDB_CONTEXT_REGISTER(v0),
+    GDB_CONTEXT_REGISTER(v1),
+    GDB_CONTEXT_REGISTER(a0),
+    GDB_CONTEXT_REGISTER(a1),
+    GDB_CONTEXT_REGISTER(a2),
+    GDB_CONTEXT_REGISTER(a3),
+    GDB_CONTEXT_REGISTER(t0),
+    GDB_CONTEXT_REGISTER(t1),
+    GDB_CONTEXT_REGISTER(t2),
+    GDB_CONTEXT_REGISTER(t3),
+    GDB_CONTEXT_REGISTER(t4),
+    GDB_CONTEXT_REGISTER(t5),
+    GDB_CONTEXT_REGISTER(t6),
+    GDB_CONTEXT_REGISTER(t7),
+    GDB_CONTEXT_REGISTER(s0),
+    GDB_CONTEXT_REGISTER(s1),
+    GDB_CONTEXT_REGISTER(s2),
+    GDB_CONTEXT_REGISTER(s3),
+    GDB_CONTEXT_REGISTER(s4),
+    GDB_CONTEXT_REGISTER(s5),
+    GDB_CONTEXT_REGISTER(s6),
+    GDB_CONTEXT_REGISTER(s7),
+    GDB_CONTEXT_REGISTER(t8),
+    GDB_CONTEXT_REGISTER(t9),
+    GDB_NO_REGISTER,
+    GDB_NO_REGISTER,
+    GDB_CONTEXT_REGISTER(gp),
+    GDB_CONTEXT_REGISTER(sp),
+    GDB_CONTEXT_REGISTER(s8),
+    GDB_CONTEXT_REGISTER(ra),
+    GDB_CONTEXT_REGISTER32(sr),
+    GDB_CONTEXT_REGISTER(lo),
+    GDB_CONTEXT_REGISTER(hi),
+    GDB_CONTEXT_REGISTER32(badvaddr),
+    GDB_CONTEXT_REGISTER32(cause),
+    {offsetof(__OSThreadContext, pc), GDBRegisterTypePC},
+    GDB_FPU_EVEN_REGISTER(fp0),
+    GDB_FPU_ODD_REGISTER(fp0),
+    GDB_FPU_EVEN_REGISTER(fp2),
+    GDB_FPU_ODD_REGISTER(fp2),
+    GDB_FPU_EVEN_REGISTER(fp4),
+    GDB_FPU_ODD_REGISTER(fp4),
+    GDB_FPU_EVEN_REGISTER(fp6),
+    GDB_FPU_ODD_REGISTER(fp6),
+    GDB_FPU_EVEN_REGISTER(fp8),
+    GDB_FPU_ODD_REGISTER(fp8),
+    GDB_FPU_EVEN_REGISTER(fp10),
+    GDB_FPU_ODD_REGISTER(fp10),
+    GDB_FPU_EVEN_REGISTER(fp12),
+    GDB_FPU_ODD_REGISTER(fp12),
+    GDB_FPU_EVEN_REGISTER(fp14),
+    GDB_FPU_ODD_REGISTER(fp14),
+    GDB_FPU_EVEN_REGISTER(fp16),
+    GDB_FPU_ODD_REGISTER(fp16),
+    GDB_FPU_EVEN_REGISTER(fp18),
+    GDB_FPU_ODD_REGISTER(fp18),
+    GDB_FPU_EVEN_REGISTER(fp20),
+    GDB_FPU_ODD_REGISTER(fp20),
+    GDB_FPU_EVEN_REGISTER(fp22),
+    GDB_FPU_ODD_REGISTER(fp22),
+    GDB_FPU_EVEN_REGISTER(fp24),
+    GDB_FPU_ODD_REGISTER(fp24),
+    GDB_FPU_EVEN_REGISTER(fp26),
+    GDB_FPU_ODD_REGISTER(fp26),
+    GDB_FPU_EVEN_REGISTER(fp28),
+    GDB_FPU_ODD_REGISTER(fp28),
+    GDB_FPU_EVEN_REGISTER(fp30),
+    GDB_FPU_ODD_REGISTER(fp30),
+    GDB_CONTEXT_REGISTER(fpcsr),
+    {0, GDBRegisterTypeFIR},
+};
+
+/**
+ * Describes the register layout above. The fpu registers are 32 bits
+ * since libultra runs the fpu with FR=0
+ */
+const char gdbTargetXml[] = 
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<architecture>mips:4300</architecture>"
+    "<feature name=\"org.gnu.gdb.mips.cpu\">"
+    "<reg name=\"r0\" bitsize=\"64\" regnum=\"0\"/>"
+    "<reg name=\"r1\" bitsize=\"64\" regnum=\"1\"/>"
+    "<reg name=\"r2\" bitsize=\"64\" regnum=\"2\"/>"
+    "<reg name=\"r3\" bitsize=\"64\" regnum=\"3\"/>"
+    "<reg name=\"r4\" bitsize=\"64\" regnum=\"4\"/>"
+    "<reg name=\"r5\" bitsize=\"64\" regnum=\"5\"/>"
+    "<reg name=\"r6\" bitsize=\"64\" regnum=\"6\"/>"
+    "<reg name=\"r7\" bitsize=\"64\" regnum=\"7\"/>"
+    "<reg name=\"r8\" bitsize=\"64\" regnum=\"8\"/>"
+    "<reg name=\"r9\" bitsize=\"64\" regnum=\"9\"/>"
+    "<reg name=\"r10\" bitsize=\"64\" regnum=\"10\"/>"
+    "<reg name=\"r11\" bitsize=\"64\" regnum=\"11\"/>"
+    "<reg name=\"r12\" bitsize=\"64\" regnum=\"12\"/>"
+    "<reg name=\"r13\" bitsize=\"64\" regnum=\"13\"/>"
+    "<reg name=\"r14\" bitsize=\"64\" regnum=\"14\"/>"
+    "<reg name=\"r15\" bitsize=\"64\" regnum=\"15\"/>"
+    "<reg name=\"r16\" bitsize=\"64\" regnum=\"16\"/>"
+    "<reg name=\"r17\" bitsize=\"64\" regnum=\"17\"/>"
+    "<reg name=\"r18\" bitsize=\"64\" regnum=\"18\"/>"
+    "<reg name=\"r19\" bitsize=\"64\" regnum=\"19\"/>"
+    "<reg name=\"r20\" bitsize=\"64\" regnum=\"20\"/>"
+    "<reg name=\"r21\" bitsize=\"64\" regnum=\"21\"/>"
+    "<reg name=\"r22\" bitsize=\"64\" regnum=\"22\"/>"
+    "<reg name=\"r23\" bitsize=\"64\" regnum=\"23\"/>"
+    "<reg name=\"r24\" bitsize=\"64\" regnum=\"24\"/>"
+    "<reg name=\"r25\" bitsize=\"64\" regnum=\"25\"/>"
+    "<reg name=\"r26\" bitsize=\"64\" regnum=\"26\"/>"
+    "<reg name=\"r27\" bitsize=\"64\" regnum=\"27\"/>"
+    "<reg name=\"r28\" bitsize=\"64\" regnum=\"28\"/>"
+    "<reg name=\"r29\" bitsize=\"64\" regnum=\"29\"/>"
+    "<reg name=\"r30\" bitsize=\"64\" regnum=\"30\"/>"
+    "<reg name=\"r31\" bitsize=\"64\" regnum=\"31\"/>"
+    "<reg name=\"lo\" bitsize=\"64\" regnum=\"33\"/>"
+    "<reg name=\"hi\" bitsize=\"64\" regnum=\"34\"/>"
+    "<reg name=\"pc\" bitsize=\"64\" regnum=\"37\"/>"
+    "</feature>"
+    "<feature name=\"org.gnu.gdb.mips.cp0\">"
+    "<reg name=\"status\" bitsize=\"64\" regnum=\"32\"/>"
+    "<reg name=\"badvaddr\" bitsize=\"64\" regnum=\"35\"/>"
+    "<reg name=\"cause\" bitsize=\"64\" regnum=\"36\"/>"
+    "</feature>"
+    "<feature name=\"org.gnu.gdb.mips.fpu\">"
+    "<reg name=\"f0\" bitsize=\"32\" type=\"ieee_single\" regnum=\"38\"/>"
+    "<reg name=\"f1\" bitsize=\"32\" type=\"ieee_single\" regnum=\"39\"/>"
+    "<reg name=\"f2\" bitsize=\"32\" type=\"ieee_single\" regnum=\"40\"/>"
+    "<reg name=\"f3\" bitsize=\"32\" type=\"ieee_single\" regnum=\"41\"/>"
+    "<reg name=\"f4\" bitsize=\"32\" type=\"ieee_single\" regnum=\"42\"/>"
+    "<reg name=\"f5\" bitsize=\"32\" type=\"ieee_single\" regnum=\"43\"/>"
+    "<reg name=\"f6\" bitsize=\"32\" type=\"ieee_single\" regnum=\"44\"/>"
+    "<reg name=\"f7\" bitsize=\"32\" type=\"ieee_single\" regnum=\"45\"/>"
+    "<reg name=\"f8\" bitsize=\"32\" type=\"ieee_single\" regnum=\"46\"/>"
+    "<reg name=\"f9\" bitsize=\"32\" type=\"ieee_single\" regnum=\"47\"/>"
+    "<reg name=\"f10\" bitsize=\"32\" type=\"ieee_single\" regnum=\"48\"/>"
+    "<reg name=\"f11\" bitsize=\"32\" type=\"ieee_single\" regnum=\"49\"/>"
+    "<reg name=\"f12\" bitsize=\"32\" type=\"ieee_single\" regnum=\"50\"/>"
+    "<reg name=\"f13\" bitsize=\"32\" type=\"ieee_single\" regnum=\"51\"/>"
+    "<reg name=\"f14\" bitsize=\"32\" type=\"ieee_single\" regnum=\"52\"/>"
+    "<reg name=\"f15\" bitsize=\"32\" type=\"ieee_single\" regnum=\"53\"/>"
+    "<reg name=\"f16\" bitsize=\"32\" type=\"ieee_single\" regnum=\"54\"/>"
+    "<reg name=\"f17\" bitsize=\"32\" type=\"ieee_single\" regnum=\"55\"/>"
+    "<reg name=\"f18\" bitsize=\"32\" type=\"ieee_single\" regnum=\"56\"/>"
+    "<reg name=\"f19\" bitsize=\"32\" type=\"ieee_single\" regnum=\"57\"/>"
+    "<reg name=\"f20\" bitsize=\"32\" type=\"ieee_single\" regnum=\"58\"/>"
+    "<reg name=\"f21\" bitsize=\"32\" type=\"ieee_single\" regnum=\"59\"/>"
+    "<reg name=\"f22\" bitsize=\"32\" type=\"ieee_single\" regnum=\"60\"/>"
+    "<reg name=\"f23\" bitsize=\"32\" type=\"ieee_single\" regnum=\"61\"/>"
+    "<reg name=\"f24\" bitsize=\"32\" type=\"ieee_single\" regnum=\"62\"/>"
+    "<reg name=\"f25\" bitsize=\"32\" type=\"ieee_single\" regnum=\"63\"/>"
+    "<reg name=\"f26\" bitsize=\"32\" type=\"ieee_single\" regnum=\"64\"/>"
+    "<reg name=\"f27\" bitsize=\"32\" type=\"ieee_single\" regnum=\"65\"/>"
+    "<reg name=\"f28\" bitsize=\"32\" type=\"ieee_single\" regnum=\"66\"/>"
+    "<reg name=\"f29\" bitsize=\"32\" type=\"ieee_single\" regnum=\"67\"/>"
+    "<reg name=\"f30\" bitsize=\"32\" type=\"ieee_single\" regnum=\"68\"/>"
+    "<reg name=\"f31\" bitsize=\"32\" type=\"ieee_single\" regnum=\"69\"/>"
+    "<reg name=\"fcsr\" bitsize=\"32\" group=\"float\" regnum=\"70\"/>"
+    "<reg name=\"fir\" bitsize=\"32\" group=\"float\" regnum=\"71\"/>"
+    "</feature>"
+    "</target>";
+
+const u32 gdbTargetXmlLength = sizeof(gdbTargetXml) - 1;
+
+u32 gdbRegisterSize(int regNum) {
+    return regNum < GDB_FIRST_FPU_REGISTER ? sizeof(u64) : sizeof(u32);
+}
+
+void gdbReplyRegister(struct GDBReply* reply, OSThread* thread, int regNum) {
+    const struct GDBRegisterLocation* location = &gdbRegisterLocations[regNum];
+    u8* field = (u8*)&thread->context + location->offset;
+
+    if (regNum >= GDB_FIRST_FPU_REGISTER && !thread->fp) {
+        // threads that never used the fpu don't have the fpu registers saved
+        gdbReplyString(reply, "xxxxxxxx");
+        return;
+    }
+
+    switch (location->type) {
+        case GDBRegisterTypeContext:
+            gdbReplyHexBytes(reply, field, gdbRegisterSize(regNum));
+            break;
+        case GDBRegisterTypeContext32:
+            gdbReplyHex64(reply, *(u32*)field);
+            break;
+        case GDBRegisterTypePC:
+            if (thread->context.pc == (u32)gdbBreak) {
+                // when inside gdbBreak, report the breakpoint to be at where the function was called
+                gdbReplyHex64(reply, (u32)thread->context.ra);
+            } else {
+                gdbReplyHex64(reply, thread->context.pc);
+            }
+            break;
+        case GDBRegisterTypeFIR:
+            gdbReplyHex32(reply, GDB_FIR_VALUE);
+            break;
+        default:
+            gdbReplyHexBytes(reply, (u8*)"\0\0\0\0\0\0\0\0", gdbRegisterSize(regNum));
+            break;
+    }
+}
+
+char* gdbWriteRegister(OSThread* thread, int regNum, char* src) {
+    const struct GDBRegisterLocation* location = &gdbRegisterLocations[regNum];
+    u8* field = (u8*)&thread->context + location->offset;
+    u32 size = gdbRegisterSize(regNum);
+
+    switch (location->type) {
+        case GDBRegisterTypeContext:
+            gdbReadHex(field, src, size);
+            break;
+        case GDBRegisterTypeContext32:
+        case GDBRegisterTypePC:
+            // only the low 32 bits are saved
+            gdbReadHex(field, src + 8, sizeof(u32));
+            break;
+    }
+
+    if (regNum >= GDB_FIRST_FPU_REGISTER) {
+        // make sure the thread loads the new fpu state
+        thread->fp = 1;
+    }
+
+    return src + size * 2;
+}
+
+u64 gdbGetRegisterValue(OSThread* thread, int regNum) {
+    const struct GDBRegisterLocation* location = &gdbRegisterLocations[regNum];
+    u8* field = (u8*)&thread->context + location->offset;
+
+    switch (location->type) {
+        case GDBRegisterTypeContext:
+            return gdbRegisterSize(regNum) == sizeof(u64) ? *(u64*)field : *(u32*)field;
+        case GDBRegisterTypeContext32:
+            return *(u32*)field;
+        case GDBRegisterTypePC:
+            return thread->context.pc == (u32)gdbBreak ? (u32)thread->context.ra : thread->context.pc;
+        case GDBRegisterTypeFIR:
+            return GDB_FIR_VALUE;
+    }
+
+    return 0;
+}
+
+u32 gdbRegisterOffset(int regNum) {
+    if (regNum < GDB_FIRST_FPU_REGISTER) {
+        return regNum * sizeof(u64);
+    }
+
+    return GDB_FIRST_FPU_REGISTER * sizeof(u64) + (regNum - GDB_FIRST_FPU_REGISTER) * sizeof(u32);
+}
+
+void gdbSaveRegisters(OSThread* thread, u8* target) {
+    int regNum;
+
+    for (regNum = 0; regNum < GDB_REGISTER_COUNT; ++regNum) {
+        u64 value = gdbGetRegisterValue(thread, regNum);
+        int byte = gdbRegisterSize(regNum);
+
+        while (byte > 0) {
+            --byte;
+            target[byte] = (u8)value;
+            value >>= 8;
+        }
+
+        target += gdbRegisterSize(regNum);
+    }
+}
+
+u32 gdbGetGPR(OSThread* thread, int regNum) {
+    const struct GDBRegisterLocation* location = &gdbRegisterLocations[regNum];
+
+    if (location->type != GDBRegisterTypeContext) {
+        return 0;
+    }
+
+    return (u32)*(u64*)((u8*)&thread->context + location->offset);
+}
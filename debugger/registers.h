@@ -0,0 +1,57 @@
+#ifndef __LIBULTRA_GDB_REGISTERS_H
+#define __LIBULTRA_GDB_REGISTERS_H
+
+#include <ultra64.h>
+#include "reply.h"
+
+/* 0~ GPR0-31(yes, include zero),[32]PS(status),LO,HI,BadVAddr,Cause,PC,[38]FPR0-31,[70]fpcs,fpir */
+#define GDB_REGISTER_COUNT          72
+#define GDB_FIRST_FPU_REGISTER      38
+
+#define GDB_REGISTER_SP             29
+#define GDB_REGISTER_FP             30
+#define GDB_REGISTER_RA             31
+#define GDB_REGISTER_PC             37
+
+// every register in the layout of a g packet
+#define GDB_REGISTER_BLOCK_SIZE     (GDB_FIRST_FPU_REGISTER * sizeof(u64) + (GDB_REGISTER_COUNT - GDB_FIRST_FPU_REGISTER) * sizeof(u32))
+
+/**
+ * The target description gdb reads with qXfer:features:read
+ */
+extern const char gdbTargetXml[];
+extern const u32 gdbTargetXmlLength;
+
+/**
+ * Size of a register in bytes as gdb sees it
+ */
+u32 gdbRegisterSize(int regNum);
+/**
+ * Registers the thread doesn't have saved are sent as x so
+ * every g reply is the same length
+ */
+void gdbReplyRegister(struct GDBReply* reply, OSThread* thread, int regNum);
+/**
+ * Reads a register from gdbRegisterSize(regNum) * 2 hex characters
+ * and returns the end of the input
+ */
+char* gdbWriteRegister(OSThread* thread, int regNum, char* src);
+/**
+ * The value of any register as gdb sees it
+ */
+u64 gdbGetRegisterValue(OSThread* thread, int regNum);
+/**
+ * Where a register starts in a register block
+ */
+u32 gdbRegisterOffset(int regNum);
+/**
+ * Copies every register big endian into a block of
+ * GDB_REGISTER_BLOCK_SIZE bytes
+ */
+void gdbSaveRegisters(OSThread* thread, u8* target);
+/**
+ * The low 32 bits of a general purpose register
+ */
+u32 gdbGetGPR(OSThread* thread, int regNum);
+
+#endif
@@ -0,0 +1,196 @@
+#include "reply.h"
+#include "hex.h"
+
+// room for '#', the checksum, and a run encoded as 3 characters
+#define GDB_REPLY_FOOTER_SIZE   8
+
+#define GDB_RLE_MIN_RUN         4
+#define GDB_RLE_MAX_RUN         98
+#define GDB_RLE_COUNT_OFFSET    29
+#define GDB_RLE_HASH_RUN        (('#' - GDB_RLE_COUNT_OFFSET) + 1)
+#define GDB_RLE_DOLLAR_RUN      (('$' - GDB_RLE_COUNT_OFFSET) + 1)
+
+static void gdbReplyFlush(struct GDBReply* reply) {
+    if (reply->error == GDBErrorNone) {
+        reply->error = gdbSendMessage(GDBDataTypeGDB, reply->buffer, reply->current - reply->buffer);
+    }
+    reply->current = reply->buffer;
+}
+
+static void gdbReplyWrite(struct GDBReply* reply, char chr) {
+    *reply->current++ = chr;
+    reply->checksum += (u8)chr;
+}
+
+/**
+ * Writes the pending run of characters. Runs are written as the
+ * character followed by '*' and the repeat count + 29
+ */
+static void gdbReplyWriteRun(struct GDBReply* reply) {
+    u32 runLength = reply->runLength;
+
+    if (runLength == GDB_RLE_HASH_RUN || runLength == GDB_RLE_DOLLAR_RUN) {
+        // the repeat count can't be '#' or '$' so
+        // the end of the run is written separately
+        gdbReplyWrite(reply, reply->runChar);
+        gdbReplyWrite(reply, '*');
+        gdbReplyWrite(reply, (char)(GDB_RLE_HASH_RUN - 2 + GDB_RLE_COUNT_OFFSET));
+        runLength -= GDB_RLE_HASH_RUN - 1;
+    } else if (runLength >= GDB_RLE_MIN_RUN) {
+        gdbReplyWrite(reply, reply->runChar);
+        gdbReplyWrite(reply, '*');
+        gdbReplyWrite(reply, (char)(runLength - 1 + GDB_RLE_COUNT_OFFSET));
+        runLength = 0;
+    }
+
+    while (runLength > 0) {
+        gdbReplyWrite(reply, reply->runChar);
+        --runLength;
+    }
+
+    reply->runLength = 0;
+
+    if (reply->current >= reply->flushAt) {
+        gdbReplyFlush(reply);
+    }
+}
+
+void gdbReplyStart(struct GDBReply* reply, char* buffer, u32 bufferSize, char startChar) {
+    reply->buffer = buffer;
+    reply->current = buffer;
+    reply->flushAt = buffer + bufferSize - GDB_REPLY_FOOTER_SIZE;
+    reply->error = GDBErrorNone;
+    reply->runLength = 0;
+    reply->checksum = 0;
+    reply->runChar = 0;
+    *reply->current++ = startChar;
+}
+
+void gdbReplyChar(struct GDBReply* reply, char chr) {
+    if (reply->runLength) {
+        if (chr == reply->runChar && reply->runLength < GDB_RLE_MAX_RUN) {
+            ++reply->runLength;
+            return;
+        }
+
+        gdbReplyWriteRun(reply);
+    }
+
+    reply->runChar = chr;
+    reply->runLength = 1;
+}
+
+void gdbReplyString(struct GDBReply* reply, const char* str) {
+    while (*str) {
+        gdbReplyChar(reply, *str++);
+    }
+}
+
+void gdbReplyHexBytes(struct GDBReply* reply, const u8* src, u32 len) {
+    while (len > 0) {
+        const char* pair = gdbHexEncodeTable[*src++];
+        gdbReplyChar(reply, pair[0]);
+        gdbReplyChar(reply, pair[1]);
+        --len;
+    }
+}
+
+void gdbReplyBinary(struct GDBReply* reply, const u8* src, u32 len) {
+    while (len > 0) {
+        u8 value = *src++;
+
+        if (GDB_NEEDS_ESCAPE(value)) {
+            gdbReplyChar(reply, GDB_BINARY_ESCAPE);
+            value ^= GDB_BINARY_ESCAPE_XOR;
+        }
+
+        gdbReplyChar(reply, value);
+        --len;
+    }
+}
+
+void gdbReplyHex8(struct GDBReply* reply, u8 value) {
+    gdbReplyHexBytes(reply, &value, 1);
+}
+
+void gdbReplyHex32(struct GDBReply* reply, u32 value) {
+    gdbReplyHex8(reply, value >> 24);
+    gdbReplyHex8(reply, value >> 16);
+    gdbReplyHex8(reply, value >> 8);
+    gdbReplyHex8(reply, value);
+}
+
+void gdbReplyHex64(struct GDBReply* reply, u32 value) {
+    gdbReplyHex32(reply, 0);
+    gdbReplyHex32(reply, value);
+}
+
+void gdbReplyHexValue(struct GDBReply* reply, u32 value) {
+    int shift = 28;
+
+    while (shift > 0 && ((value >> shift) & 0xF) == 0) {
+        shift -= 4;
+    }
+
+    while (shift >= 0) {
+        gdbReplyChar(reply, gdbHexEncodeTable[(value >> shift) & 0xF][1]);
+        shift -= 4;
+    }
+}
+
+u32 gdbReplyFinish(struct GDBReply* reply) {
+    if (reply->runLength) {
+        gdbReplyWriteRun(reply);
+    }
+
+    u8 checksum = reply->checksum;
+    *reply->current++ = '#';
+    *reply->current++ = gdbHexEncodeTable[checksum][0];
+    *reply->current++ = gdbHexEncodeTable[checksum][1];
+
+    return reply->current - reply->buffer;
+}
+
+enum GDBError gdbReplySend(struct GDBReply* reply) {
+    gdbReplyFinish(reply);
+    gdbReplyFlush(reply);
+
+    return reply->error;
+}
+
+char* gdbFormatDecimal(char* target, int value) {
+    char digits[12];
+    int digitCount = 0;
+    u32 remaining = value;
+
+    if (value < 0) {
+        *target++ = '-';
+        remaining = -value;
+    }
+
+    do {
+        digits[digitCount++] = '0' + remaining % 10;
+        remaining /= 10;
+    } while (remaining);
+
+    while (digitCount > 0) {
+        *target++ = digits[--digitCount];
+    }
+
+    return target;
+}
+
+char* gdbFormatHex(char* target, u32 value) {
+    int shift = 28;
+
+    while (shift > 0 && ((value >> shift) & 0xF) == 0) {
+        shift -= 4;
+    }
+
+    while (shift >= 0) {
+        *target++ = gdbHexEncodeTable[(value >> shift) & 0xF][1];
+        shift -= 4;
+    }
+
+    return target;
+}
@@ -0,0 +1,74 @@
+#ifndef __LIBULTRA_GDB_REPLY_H
+#define __LIBULTRA_GDB_REPLY_H
+
+#include "serial.h"
+
+#define GDB_BINARY_ESCAPE       '}'
+#define GDB_BINARY_ESCAPE_XOR   0x20
+#define GDB_NEEDS_ESCAPE(chr)   ((chr) == '#' || (chr) == '$' || (chr) == '}' || (chr) == '*')
+
+/**
+ * Builds a packet one piece at a time. The data is run length encoded 
+ * and checksummed as it is appended so the packet is finished in a 
+ * single pass. When the buffer fills up the data so far is sent to the
+ * host so a packet can be much larger than the buffer
+ */
+struct GDBReply {
+    char* buffer;
+    char* current;
+    char* flushAt;
+    enum GDBError error;
+    u32 runLength;
+    u8 checksum;
+    char runChar;
+};
+
+/**
+ * Starts a new packet
+ * @param startChar '$' for a packet or '%' for a notification
+ */
+void gdbReplyStart(struct GDBReply* reply, char* buffer, u32 bufferSize, char startChar);
+void gdbReplyChar(struct GDBReply* reply, char chr);
+void gdbReplyString(struct GDBReply* reply, const char* str);
+/**
+ * Writes each byte as two hex characters
+ */
+void gdbReplyHexBytes(struct GDBReply* reply, const u8* src, u32 len);
+/**
+ * Writes each byte escaped for binary packets
+ */
+void gdbReplyBinary(struct GDBReply* reply, const u8* src, u32 len);
+/**
+ * Fixed width hex
+ */
+void gdbReplyHex8(struct GDBReply* reply, u8 value);
+void gdbReplyHex32(struct GDBReply* reply, u32 value);
+/**
+ * A 32 bit value zero extended to a 64 bit register
+ */
+void gdbReplyHex64(struct GDBReply* reply, u32 value);
+/**
+ * Hex without leading zeros
+ */
+void gdbReplyHexValue(struct GDBReply* reply, u32 value);
+/**
+ * Writes the '#' and checksum without sending the packet. Returns the
+ * length of the packet in the buffer. Only useful if the buffer is
+ * large enough that the packet was never flushed
+ */
+u32 gdbReplyFinish(struct GDBReply* reply);
+/**
+ * Writes the '#' and checksum and sends what is left of the packet
+ */
+enum GDBError gdbReplySend(struct GDBReply* reply);
+
+/**
+ * Writes value in decimal and returns the end of the output
+ */
+char* gdbFormatDecimal(char* target, int value);
+/**
+ * Writes value in hex without leading zeros and returns the end of the output
+ */
+char* gdbFormatHex(char* target, u32 value);
+
+#endif
@@ -33,6 +33,8 @@ enum GDBDataType {
     GDBDataTypeScreenshot,
     GDBDataTypeGDB,
     GDBDataTypeControllerData,
+    GDBDataTypeProfile,
+    GDBDataTypeZones,
 };
 
 enum GDBCartType {
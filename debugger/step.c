@@ -0,0 +1,99 @@
+#include "step.h"
+#include "registers.h"
+
+#define GDB_OPCODE(instr)       ((instr) >> 26)
+#define GDB_RS(instr)           (((instr) >> 21) & 0x1F)
+#define GDB_RT(instr)           (((instr) >> 16) & 0x1F)
+#define GDB_FUNCT(instr)        ((instr) & 0x3F)
+#define GDB_BRANCH_OFFSET(instr) ((s32)(s16)((instr) & 0xFFFF) << 2)
+#define GDB_JUMP_TARGET(pc, instr) ((((pc) + 4) & 0xF0000000) | (((instr) & 0x03FFFFFF) << 2))
+
+#define GDB_OP_SPECIAL      0x00
+#define GDB_OP_REGIMM       0x01
+#define GDB_OP_J            0x02
+#define GDB_OP_JAL          0x03
+#define GDB_OP_BEQ          0x04
+#define GDB_OP_BGTZ         0x07
+#define GDB_OP_COP0         0x10
+#define GDB_OP_COP2         0x12
+#define GDB_OP_BEQL         0x14
+#define GDB_OP_BGTZL        0x17
+
+#define GDB_OP_LDL          0x1A
+#define GDB_OP_LDR          0x1B
+#define GDB_OP_LB           0x20
+
+#define GDB_FUNCT_JR        0x08
+#define GDB_FUNCT_JALR      0x09
+
+// BLTZ, BGEZ, BLTZL, BGEZL and the AL versions
+#define GDB_IS_REGIMM_BRANCH(rt) (((rt) & 0x1C) == 0x00 || ((rt) & 0x1C) == 0x10)
+#define GDB_COP_BC          0x08
+
+int gdbIsConditionalBranch(u32 instr) {
+    u32 opcode = GDB_OPCODE(instr);
+
+    return (opcode >= GDB_OP_BEQ && opcode <= GDB_OP_BGTZ) ||
+        (opcode >= GDB_OP_BEQL && opcode <= GDB_OP_BGTZL) ||
+        (opcode == GDB_OP_REGIMM && GDB_IS_REGIMM_BRANCH(GDB_RT(instr))) ||
+        (opcode >= GDB_OP_COP0 && opcode <= GDB_OP_COP2 && GDB_RS(instr) == GDB_COP_BC);
+}
+
+// the unaligned loads and stores can reach either side of the address
+#define GDB_UNALIGNED_ACCESS    0xFF
+
+// bytes accessed by each load and store starting at LB
+static const u8 gdbAccessSizes[] = {
+    // LB LH LWL LW LBU LHU LWR LWU
+    1, 2, GDB_UNALIGNED_ACCESS, 4, 1, 2, GDB_UNALIGNED_ACCESS, 4,
+    // SB SH SWL SW SDL SDR SWR CACHE
+    1, 2, GDB_UNALIGNED_ACCESS, 4, GDB_UNALIGNED_ACCESS, GDB_UNALIGNED_ACCESS, GDB_UNALIGNED_ACCESS, 0,
+    // LL LWC1 LWC2 - LLD LDC1 LDC2 LD
+    4, 4, 4, 0, 8, 8, 8, 8,
+    // SC SWC1 SWC2 - SCD SDC1 SDC2 SD
+    4, 4, 4, 0, 8, 8, 8, 8,
+};
+
+u32 gdbGetMemoryAccess(OSThread* thread, u32 instr, u32* addr) {
+    u32 opcode = GDB_OPCODE(instr);
+    u32 size;
+
+    if (opcode >= GDB_OP_LB) {
+        size = gdbAccessSizes[opcode - GDB_OP_LB];
+    } else if (opcode == GDB_OP_LDL || opcode == GDB_OP_LDR) {
+        size = GDB_UNALIGNED_ACCESS;
+    } else {
+        return 0;
+    }
+
+    *addr = gdbGetGPR(thread, GDB_RS(instr)) + (s32)(s16)(instr & 0xFFFF);
+
+    if (size == GDB_UNALIGNED_ACCESS) {
+        // assume the whole aligned doubleword is accessed
+        *addr &= ~0x7;
+        size = 8;
+    }
+
+    return size;
+}
+
+int gdbGetNextPCs(OSThread* thread, u32 pc, u32 instr, u32* nextPCs) {
+    u32 opcode = GDB_OPCODE(instr);
+
+    if (gdbIsConditionalBranch(instr)) {
+        // likely branches skip the delay slot when not taken
+        // so both kinds continue at pc + 8
+        nextPCs[0] = pc + 4 + GDB_BRANCH_OFFSET(instr);
+        nextPCs[1] = pc + 8;
+        return nextPCs[0] == nextPCs[1] ? 1 : 2;
+    } else if (opcode == GDB_OP_J || opcode == GDB_OP_JAL) {
+        nextPCs[0] = GDB_JUMP_TARGET(pc, instr);
+        return 1;
+    } else if (opcode == GDB_OP_SPECIAL && (GDB_FUNCT(instr) == GDB_FUNCT_JR || GDB_FUNCT(instr) == GDB_FUNCT_JALR)) {
+        nextPCs[0] = gdbGetGPR(thread, GDB_RS(instr));
+        return 1;
+    }
+
+    nextPCs[0] = pc + 4;
+    return 1;
+}
@@ -0,0 +1,25 @@
+#ifndef __LIBULTRA_GDB_STEP_H
+#define __LIBULTRA_GDB_STEP_H
+
+#include <ultra64.h>
+
+// a conditional branch can continue at the target or after the delay slot
+#define GDB_MAX_NEXT_PCS    2
+
+/**
+ * Finds the addresses the thread could execute next after 
+ * running the instruction at pc. Branches and jumps are run
+ * together with their delay slot
+ * @param instr the instruction at pc
+ * @param nextPCs filled with up to GDB_MAX_NEXT_PCS addresses
+ * @returns the number of addresses in nextPCs
+ */
+int gdbGetNextPCs(OSThread* thread, u32 pc, u32 instr, u32* nextPCs);
+/**
+ * Finds the memory a load or store instruction accesses
+ * @param addr set to the first byte accessed
+ * @returns the number of bytes accessed or 0 if instr doesn't access memory
+ */
+u32 gdbGetMemoryAccess(OSThread* thread, u32 instr, u32* addr);
+
+#endif
@@ -0,0 +1,243 @@
+#include "threads.h"
+#include "debugger.h"
+#include "libultra.h"
+
+#if GDB_MAX_THREADS > 32
+#error "GDB_MAX_THREADS can't be more than 32"
+#endif
+
+// twice the thread count keeps probe chains short
+#define GDB_THREAD_HASH_SIZE    (GDB_MAX_THREADS * 2)
+#define GDB_THREAD_HASH(id)     ((((u32)(id) * 2654435761u) >> 16) % GDB_THREAD_HASH_SIZE)
+
+static OSThread* gdbThreads[GDB_MAX_THREADS];
+// the slot + 1 of each thread hashed by id. 0 is an empty bucket
+static u8 gdbThreadHash[GDB_THREAD_HASH_SIZE];
+// the debugger stopped the thread in this slot
+static u8 gdbThreadIsHeld[GDB_MAX_THREADS];
+
+static OSId gdbIncludedThreads[GDB_MAX_THREAD_FILTERS];
+static u32 gdbIncludedThreadCount;
+static OSId gdbExcludedThreads[GDB_MAX_THREAD_FILTERS];
+static u32 gdbExcludedThreadCount;
+
+static int gdbHasThreadId(OSId* ids, u32 count, OSId id) {
+    int i;
+    for (i = 0; i < count; ++i) {
+        if (ids[i] == id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void gdbIncludeThread(OSId id) {
+    if (gdbIncludedThreadCount < GDB_MAX_THREAD_FILTERS && !gdbHasThreadId(gdbIncludedThreads, gdbIncludedThreadCount, id)) {
+        gdbIncludedThreads[gdbIncludedThreadCount++] = id;
+    }
+}
+
+void gdbExcludeThread(OSId id) {
+    if (gdbExcludedThreadCount < GDB_MAX_THREAD_FILTERS && !gdbHasThreadId(gdbExcludedThreads, gdbExcludedThreadCount, id)) {
+        gdbExcludedThreads[gdbExcludedThreadCount++] = id;
+    }
+}
+
+int gdbCanStopThread(OSThread* thread) {
+    return thread->priority > OS_PRIORITY_IDLE && thread->priority <= OS_PRIORITY_APPMAX;
+}
+
+static int gdbIsThreadDebugged(OSThread* thread) {
+    if (gdbHasThreadId(gdbExcludedThreads, gdbExcludedThreadCount, thread->id)) {
+        return 0;
+    }
+
+    if (gdbIncludedThreadCount == 0) {
+        return gdbCanStopThread(thread);
+    }
+
+    return gdbHasThreadId(gdbIncludedThreads, gdbIncludedThreadCount, thread->id);
+}
+
+static void gdbRebuildThreadHash() {
+    int i;
+
+    bzero(gdbThreadHash, sizeof(gdbThreadHash));
+
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        if (gdbThreads[i]) {
+            u32 bucket = GDB_THREAD_HASH(gdbThreads[i]->id);
+
+            while (gdbThreadHash[bucket]) {
+                bucket = (bucket + 1) % GDB_THREAD_HASH_SIZE;
+            }
+
+            gdbThreadHash[bucket] = i + 1;
+        }
+    }
+}
+
+u32 gdbRefreshThreads() {
+    OSThread* added[GDB_MAX_THREADS];
+    u32 addedCount = 0;
+    u32 seen = 0;
+    u32 changed = 0;
+    int i;
+
+    u32 saveMask = __osDisableInt();
+
+    OSThread* thread;
+    for (thread = __osActiveQueue; thread && thread->priority != GDB_THREAD_TAIL_PRIORITY; thread = thread->tlnext) {
+        if (!gdbIsThreadDebugged(thread)) {
+            continue;
+        }
+
+        int index = gdbThreadIndex(thread);
+
+        if (index != -1) {
+            seen |= 1 << index;
+        } else if (addedCount < GDB_MAX_THREADS) {
+            added[addedCount++] = thread;
+        }
+    }
+
+    __osRestoreInt(saveMask);
+
+    for (i = 0; i < GDB_MAX_THREADS; ++i) {
+        if (gdbThreads[i] && !(seen & (1 << i))) {
+            // the thread was destroyed
+            gdbThreads[i] = NULL;
+            gdbThreadIsHeld[i] = 0;
+            changed |= 1 << i;
+        }
+    }
+
+    for (i = 0; i < GDB_MAX_THREADS && addedCount > 0; ++i) {
+        if (!gdbThreads[i]) {
+            gdbThreads[i] = added[--addedCount];
+            changed |= 1 << i;
+        }
+    }
+
+    if (changed) {
+        gdbRebuildThreadHash();
+    }
+
+    return changed;
+}
+
+OSThread* gdbThreadAt(int index) {
+    return gdbThreads[index];
+}
+
+OSThread* gdbFindThread(OSId id) {
+    int i;
+
+    if (id == GDB_ANY_THREAD) {
+        OSThread* result = NULL;
+        OSThread* systemThread = NULL;
+
+        for (i = 0; i < GDB_MAX_THREADS; ++i) {
+            if (!gdbThreads[i]) {
+                continue;
+            } else if (gdbIsThreadStopped(gdbThreads[i])) {
+                return gdbThreads[i];
+            } else if (!result && gdbCanStopThread(gdbThreads[i])) {
+                result = gdbThreads[i];
+            } else if (!systemThread) {
+                systemThread = gdbThreads[i];
+            }
+        }
+
+        return result ? result : systemThread;
+    }
+
+    u32 bucket = GDB_THREAD_HASH(id);
+
+    while (gdbThreadHash[bucket]) {
+        OSThread* thread = gdbThreads[gdbThreadHash[bucket] - 1];
+
+        if (thread->id == id) {
+            return thread;
+        }
+
+        bucket = (bucket + 1) % GDB_THREAD_HASH_SIZE;
+    }
+
+    return NULL;
+}
+
+int gdbThreadIndex(OSThread* thread) {
+    if (!thread) {
+        return -1;
+    }
+
+    u32 bucket = GDB_THREAD_HASH(thread->id);
+
+    while (gdbThreadHash[bucket]) {
+        int index = gdbThreadHash[bucket] - 1;
+
+        if (gdbThreads[index] == thread) {
+            return index;
+        }
+
+        bucket = (bucket + 1) % GDB_THREAD_HASH_SIZE;
+    }
+
+    return -1;
+}
+
+OSThread* gdbNextThread(OSThread* curr, OSId id) {
+    if (id == GDB_ALL_THREADS) {
+        int i = curr ? gdbThreadIndex(curr) + 1 : 0;
+
+        for (; i < GDB_MAX_THREADS; ++i) {
+            if (gdbThreads[i]) {
+                return gdbThreads[i];
+            }
+        }
+
+        return NULL;
+    } else {
+        if (curr) {
+            return NULL;
+        } else {
+            return gdbFindThread(id);
+        }
+    }
+}
+
+void gdbStopThread(OSThread* thread) {
+    if (!gdbCanStopThread(thread)) {
+        return;
+    }
+
+    int index = gdbThreadIndex(thread);
+
+    // marked first since a thread can stop itself
+    if (index != -1) {
+        gdbThreadIsHeld[index] = 1;
+    }
+
+    osStopThread(thread);
+}
+
+void gdbStartThread(OSThread* thread) {
+    int index = gdbThreadIndex(thread);
+
+    if (index != -1) {
+        gdbThreadIsHeld[index] = 0;
+    }
+
+    osStartThread(thread);
+}
+
+int gdbIsThreadStopped(OSThread* thread) {
+    if (thread->flags & OS_FLAG_FAULT) {
+        return 1;
+    }
+
+    int index = gdbThreadIndex(thread);
+
+    return index != -1 && gdbThreadIsHeld[index] && thread->state == OS_STATE_STOPPED;
+}
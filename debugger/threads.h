@@ -0,0 +1,63 @@
+#ifndef __LIBULTRA_GDB_THREADS_H
+#define __LIBULTRA_GDB_THREADS_H
+
+#include <ultra64.h>
+
+// the most threads gdb can see at once. gdbRefreshThreads
+// reports changed slots as bits in a u32 so this can't go past 32
+#ifndef GDB_MAX_THREADS
+#define GDB_MAX_THREADS         32
+#endif
+
+#define GDB_MAX_THREAD_FILTERS  16
+
+#define GDB_ANY_THREAD          0
+#define GDB_ALL_THREADS         -1
+
+/**
+ * Syncs the thread list with every thread libultra has created
+ * that passes the filters set by gdbIncludeThread and gdbExcludeThread.
+ * Without any included threads only threads gdbCanStopThread allows
+ * are added.
+ * A thread keeps its slot for as long as it exists
+ * @returns a bit for each slot that now holds a different thread
+ */
+u32 gdbRefreshThreads();
+/**
+ * @returns NULL if the slot is empty
+ */
+OSThread* gdbThreadAt(int index);
+/**
+ * Finds a thread by id using a hash of the thread list.
+ * GDB_ANY_THREAD prefers a thread that is stopped and then
+ * a thread the debugger can stop
+ */
+OSThread* gdbFindThread(OSId id);
+/**
+ * @returns the slot of thread or -1 if gdb can't see it
+ */
+int gdbThreadIndex(OSThread* thread);
+/**
+ * Iterates the threads matching id. Start with curr as NULL
+ */
+OSThread* gdbNextThread(OSThread* curr, OSId id);
+
+/**
+ * libultra's idle thread and the threads above OS_PRIORITY_APPMAX, 
+ * such as the VI and PI managers, are never stopped. The debugger 
+ * needs the PI manager to talk to the host
+ */
+int gdbCanStopThread(OSThread* thread);
+/**
+ * Stops a thread and remembers the debugger stopped it so threads
+ * the game stopped itself aren't reported as stops. Does nothing 
+ * if gdbCanStopThread is false
+ */
+void gdbStopThread(OSThread* thread);
+void gdbStartThread(OSThread* thread);
+/**
+ * Checks if thread faulted or was stopped by the debugger
+ */
+int gdbIsThreadStopped(OSThread* thread);
+
+#endif
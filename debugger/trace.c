@@ -0,0 +1,801 @@
+#include "trace.h"
+#include "debugger.h"
+#include "breakpoint.h"
+#include "registers.h"
+#include "agent.h"
+#include "hex.h"
+#include <string.h>
+
+// u16 tracepoint number then u32 length of the blocks
+#define GDB_TRACE_FRAME_HEADER_SIZE     6
+// 'M' u64 address u16 length then the data
+#define GDB_TRACE_MEMORY_HEADER_SIZE    11
+
+#define GDB_TRACE_IS_RUNNING    (1 << 0)
+#define GDB_TRACE_IS_CIRCULAR   (1 << 1)
+
+enum GDBTraceStopReason {
+    GDBTraceStopReasonNotRun,
+    GDBTraceStopReasonStop,
+    GDBTraceStopReasonFull,
+    GDBTraceStopReasonPassCount,
+};
+
+struct GDBTracepoint {
+    // 0 when the slot isn't in use. gdb numbers tracepoints starting at 1
+    u32 number;
+    u32 addr;
+    u32 passCount;
+    u32 hitCount;
+    u8 isEnabled;
+    u8 collectRegisters;
+    u8 conditionLength;
+    u8 actionsLength;
+    u8 condition[GDB_TRACE_CONDITION_SIZE];
+    // 'M' s8 base register, s32 offset, u16 length or 'X' u16 length, bytecode
+    u8 actions[GDB_TRACE_ACTIONS_SIZE];
+};
+
+static struct GDBTracepoint gdbTracepoints[GDB_MAX_TRACEPOINTS];
+
+/**
+ * Frames are kept in the order they were collected. Once a circular 
+ * buffer wraps the frames run from gdbTraceHead to gdbTraceWrap
+ * then from the start of the buffer to gdbTraceTail
+ */
+static u8 gdbTraceBuffer[GDB_TRACE_BUFFER_SIZE];
+static u32 gdbTraceHead;
+static u32 gdbTraceTail;
+// 0 until the buffer wraps
+static u32 gdbTraceWrap;
+static u32 gdbTraceFrameCount;
+static u32 gdbTraceCreated;
+
+// frames are built here so a frame is never split by the end of the buffer
+static u8 gdbTraceStaging[GDB_TRACE_FRAME_SIZE];
+static u32 gdbTraceStagingLength;
+
+static int gdbTraceFlags;
+static enum GDBTraceStopReason gdbTraceStopReason;
+static u32 gdbTraceStopTracepoint;
+
+static int gdbSelectedFrame = GDB_NO_TRACE_FRAME;
+static u32 gdbSelectedFrameOffset;
+
+static u32 gdbTraceReadU32(const u8* src) {
+    return (src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+}
+
+static void gdbTraceWriteU32(u8* target, u32 value) {
+    target[0] = (u8)(value >> 24);
+    target[1] = (u8)(value >> 16);
+    target[2] = (u8)(value >> 8);
+    target[3] = (u8)value;
+}
+
+/**
+ * Parses every hex character at src keeping the low 32 bits. gdb
+ * sends addresses sign extended to 64 bits
+ */
+static char* gdbTraceParseHex(char* src, char* packetEnd, u32* value) {
+    u32 result = 0;
+
+    while (src < packetEnd && gdbReadHexDigit(*src) >= 0) {
+        result = (result << 4) | gdbReadHexDigit(*src);
+        ++src;
+    }
+
+    *value = result;
+    return src;
+}
+
+static struct GDBTracepoint* gdbFindTracepoint(u32 number, u32 addr) {
+    int i;
+    for (i = 0; i < GDB_MAX_TRACEPOINTS; ++i) {
+        if (gdbTracepoints[i].number == number && gdbTracepoints[i].addr == addr) {
+            return &gdbTracepoints[i];
+        }
+    }
+    return NULL;
+}
+
+static void gdbResetTraceBuffer() {
+    gdbTraceHead = 0;
+    gdbTraceTail = 0;
+    gdbTraceWrap = 0;
+    gdbTraceFrameCount = 0;
+    gdbTraceCreated = 0;
+    gdbSelectedFrame = GDB_NO_TRACE_FRAME;
+}
+
+static void gdbRemoveTracepointBreakpoints() {
+    int i;
+    for (i = 0; i < GDB_MAX_TRACEPOINTS; ++i) {
+        struct GDBBreakpoint* brk = gdbFindBreakpoint(gdbTracepoints[i].addr);
+
+        // a user breakpoint at the same address stays
+        if (gdbTracepoints[i].number && brk && brk->type == GDBBreakpointTypeTracepoint) {
+            gdbRemoveBreakpoint(brk);
+        }
+    }
+}
+
+static void gdbEndTrace(enum GDBTraceStopReason reason, u32 tracepoint) {
+    if (gdbTraceFlags & GDB_TRACE_IS_RUNNING) {
+        gdbRemoveTracepointBreakpoints();
+        gdbTraceFlags &= ~GDB_TRACE_IS_RUNNING;
+        gdbTraceStopReason = reason;
+        gdbTraceStopTracepoint = tracepoint;
+    }
+}
+
+void gdbClearTracepoints() {
+    gdbEndTrace(GDBTraceStopReasonStop, 0);
+    bzero(gdbTracepoints, sizeof(gdbTracepoints));
+    gdbResetTraceBuffer();
+    gdbTraceStopReason = GDBTraceStopReasonNotRun;
+}
+
+/**
+ * Parses the actions in QTDP:-n:addr:action. gdb sends one action
+ * per packet but any number are accepted
+ */
+static enum GDBError gdbParseTraceActions(struct GDBTracepoint* tracepoint, char* src, char* packetEnd) {
+    if (src < packetEnd && *src == 'S') {
+        // while-stepping actions would need the thread to be stepped
+        // after each hit which defeats the point of a quick collection
+        return GDBErrorNone;
+    }
+
+    while (src < packetEnd && *src != '-') {
+        u8* target = &tracepoint->actions[tracepoint->actionsLength];
+        u32 value;
+
+        switch (*src) {
+            case 'R':
+                // every register is collected no matter the mask
+                src = gdbTraceParseHex(src + 1, packetEnd, &value);
+                tracepoint->collectRegisters = 1;
+                break;
+            case 'M':
+            {
+                u32 offset;
+                u32 len;
+                s8 baseRegister = -1;
+                ++src;
+
+                if (*src == '-') {
+                    // M-1 is an absolute address
+                    src = gdbTraceParseHex(src + 1, packetEnd, &value);
+                } else {
+                    src = gdbTraceParseHex(src, packetEnd, &value);
+                    baseRegister = (s8)value;
+                }
+
+                src = gdbTraceParseHex(src + 1, packetEnd, &offset);
+                src = gdbTraceParseHex(src + 1, packetEnd, &len);
+
+                if (tracepoint->actionsLength + 8 > GDB_TRACE_ACTIONS_SIZE) {
+                    return GDBErrorBufferTooSmall;
+                }
+
+                target[0] = 'M';
+                target[1] = (u8)baseRegister;
+                gdbTraceWriteU32(&target[2], offset);
+                target[6] = (u8)(len >> 8);
+                target[7] = (u8)len;
+                tracepoint->actionsLength += 8;
+                break;
+            }
+            case 'X':
+            {
+                u32 len;
+                src = gdbTraceParseHex(src + 1, packetEnd, &len) + 1;
+
+                // checked before any math on len so it can't wrap
+                if (len > GDB_TRACE_ACTIONS_SIZE) {
+                    return GDBErrorBufferTooSmall;
+                }
+
+                if (src + len * 2 > packetEnd) {
+                    return GDBErrorBadPacket;
+                }
+
+                if (tracepoint->actionsLength + 3 + len > GDB_TRACE_ACTIONS_SIZE) {
+                    return GDBErrorBufferTooSmall;
+                }
+
+                target[0] = 'X';
+                target[1] = (u8)(len >> 8);
+                target[2] = (u8)len;
+                gdbReadHex(&target[3], src, len);
+                tracepoint->actionsLength += 3 + len;
+                src += len * 2;
+                break;
+            }
+            default:
+                return GDBErrorBadPacket;
+        }
+    }
+
+    return GDBErrorNone;
+}
+
+enum GDBError gdbDefineTracepoint(char* src, char* packetEnd) {
+    int isAction = *src == '-';
+    u32 number;
+    u32 addr;
+
+    if (isAction) {
+        ++src;
+    }
+
+    src = gdbTraceParseHex(src, packetEnd, &number);
+    src = gdbTraceParseHex(src + 1, packetEnd, &addr) + 1;
+
+    if (!number || src > packetEnd) {
+        return GDBErrorBadPacket;
+    }
+
+    struct GDBTracepoint* tracepoint = gdbFindTracepoint(number, addr);
+
+    if (isAction) {
+        return tracepoint ? gdbParseTraceActions(tracepoint, src, packetEnd) : GDBErrorBadPacket;
+    }
+
+    if (!tracepoint) {
+        tracepoint = gdbFindTracepoint(0, 0);
+
+        if (!tracepoint) {
+            return GDBErrorBufferTooSmall;
+        }
+    }
+
+    bzero(tracepoint, sizeof(struct GDBTracepoint));
+    tracepoint->number = number;
+    tracepoint->addr = addr;
+    tracepoint->isEnabled = *src == 'E';
+
+    u32 step;
+    src = gdbTraceParseHex(src + 2, packetEnd, &step);
+    src = gdbTraceParseHex(src + 1, packetEnd, &tracepoint->passCount);
+
+    while (src < packetEnd && *src == ':') {
+        u32 len;
+        ++src;
+
+        if (*src == 'X') {
+            src = gdbTraceParseHex(src + 1, packetEnd, &len) + 1;
+
+            if (len > GDB_TRACE_CONDITION_SIZE || src + len * 2 > packetEnd) {
+                tracepoint->number = 0;
+                return GDBErrorBufferTooSmall;
+            }
+
+            gdbReadHex(tracepoint->condition, src, len);
+            tracepoint->conditionLength = (u8)len;
+            src += len * 2;
+        } else {
+            // fast tracepoint jump lengths don't apply since hits always trap
+            src = gdbTraceParseHex(src + 1, packetEnd, &len);
+        }
+    }
+
+    return GDBErrorNone;
+}
+
+enum GDBError gdbStartTrace() {
+    int i;
+
+    gdbEndTrace(GDBTraceStopReasonStop, 0);
+
+    for (i = 0; i < GDB_MAX_TRACEPOINTS; ++i) {
+        struct GDBTracepoint* tracepoint = &gdbTracepoints[i];
+        tracepoint->hitCount = 0;
+
+        if (tracepoint->number && tracepoint->isEnabled && !gdbInsertBreakPoint(tracepoint->addr, GDBBreakpointTypeTracepoint)) {
+            gdbRemoveTracepointBreakpoints();
+            return GDBErrorBufferTooSmall;
+        }
+    }
+
+    gdbResetTraceBuffer();
+    gdbTraceFlags |= GDB_TRACE_IS_RUNNING;
+    return GDBErrorNone;
+}
+
+void gdbStopTrace() {
+    gdbEndTrace(GDBTraceStopReasonStop, 0);
+}
+
+int gdbIsTracing() {
+    return gdbTraceFlags & GDB_TRACE_IS_RUNNING;
+}
+
+int gdbIsTracepoint(u32 addr) {
+    int i;
+
+    if (!gdbIsTracing()) {
+        return 0;
+    }
+
+    for (i = 0; i < GDB_MAX_TRACEPOINTS; ++i) {
+        if (gdbTracepoints[i].number && gdbTracepoints[i].isEnabled && gdbTracepoints[i].addr == addr) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void gdbSetTraceCircular(int circular) {
+    if (circular) {
+        gdbTraceFlags |= GDB_TRACE_IS_CIRCULAR;
+    } else {
+        gdbTraceFlags &= ~GDB_TRACE_IS_CIRCULAR;
+    }
+}
+
+static u32 gdbTraceFrameSize(u32 offset) {
+    return GDB_TRACE_FRAME_HEADER_SIZE + gdbTraceReadU32(&gdbTraceBuffer[offset + 2]);
+}
+
+static u32 gdbNextTraceFrame(u32 offset) {
+    offset += gdbTraceFrameSize(offset);
+    return (gdbTraceWrap && offset == gdbTraceWrap) ? 0 : offset;
+}
+
+static void gdbDiscardTraceFrame() {
+    u32 next = gdbTraceHead + gdbTraceFrameSize(gdbTraceHead);
+
+    if (gdbTraceWrap && next == gdbTraceWrap) {
+        next = 0;
+        gdbTraceWrap = 0;
+    }
+
+    gdbTraceHead = next;
+    --gdbTraceFrameCount;
+    // the frame numbers all shift down
+    gdbSelectedFrame = GDB_NO_TRACE_FRAME;
+
+    if (!gdbTraceFrameCount) {
+        gdbTraceHead = 0;
+        gdbTraceTail = 0;
+        gdbTraceWrap = 0;
+    }
+}
+
+/**
+ * Makes len bytes of room at gdbTraceTail. Returns 0 if the 
+ * buffer is full and isn't circular
+ */
+static int gdbMakeTraceRoom(u32 len) {
+    if (!(gdbTraceFlags & GDB_TRACE_IS_CIRCULAR)) {
+        return gdbTraceTail + len <= GDB_TRACE_BUFFER_SIZE;
+    }
+
+    while (1) {
+        if (!gdbTraceWrap) {
+            if (gdbTraceTail + len <= GDB_TRACE_BUFFER_SIZE) {
+                return 1;
+            }
+
+            gdbTraceWrap = gdbTraceTail;
+            gdbTraceTail = 0;
+        }
+
+        if (gdbTraceTail + len <= gdbTraceHead) {
+            return 1;
+        }
+
+        gdbDiscardTraceFrame();
+    }
+}
+
+/**
+ * Reserves room in the staged frame. Returns NULL if the
+ * frame is full
+ */
+static u8* gdbTraceReserve(u32 len) {
+    if (gdbTraceStagingLength + len > GDB_TRACE_FRAME_SIZE) {
+        return NULL;
+    }
+
+    u8* result = &gdbTraceStaging[gdbTraceStagingLength];
+    gdbTraceStagingLength += len;
+    return result;
+}
+
+static enum GDBAgentResult gdbTraceCollectMemory(u32 addr, u32 len) {
+    u8* src = gdbTranslateAddr((void*)addr);
+
+    if (!src || gdbReadableLength(src, len) < len) {
+        return GDBAgentResultBadMemory;
+    }
+
+    if (gdbTraceStagingLength + GDB_TRACE_MEMORY_HEADER_SIZE + len > GDB_TRACE_FRAME_SIZE) {
+        // keep what fits
+        len = GDB_TRACE_FRAME_SIZE - gdbTraceStagingLength;
+        len = len > GDB_TRACE_MEMORY_HEADER_SIZE ? len - GDB_TRACE_MEMORY_HEADER_SIZE : 0;
+
+        if (!len) {
+            return GDBAgentResultOK;
+        }
+    }
+
+    u8* target = gdbTraceReserve(GDB_TRACE_MEMORY_HEADER_SIZE + len);
+    target[0] = 'M';
+    // addresses are sign extended the way gdb sees them
+    gdbTraceWriteU32(&target[1], (s32)addr < 0 ? 0xFFFFFFFF : 0);
+    gdbTraceWriteU32(&target[5], addr);
+    target[9] = (u8)(len >> 8);
+    target[10] = (u8)len;
+    bcopy(src, &target[GDB_TRACE_MEMORY_HEADER_SIZE], len);
+
+    return GDBAgentResultOK;
+}
+
+static void gdbTraceRunActions(struct GDBTracepoint* tracepoint, OSThread* thread) {
+    u32 offset = 0;
+
+    while (offset < tracepoint->actionsLength) {
+        u8* action = &tracepoint->actions[offset];
+
+        if (action[0] == 'M') {
+            u32 addr = gdbTraceReadU32(&action[2]);
+
+            if ((s8)action[1] >= 0) {
+                addr += (u32)gdbGetRegisterValue(thread, (s8)action[1]);
+            }
+
+            gdbTraceCollectMemory(addr, (action[6] << 8) | action[7]);
+            offset += 8;
+        } else {
+            u32 len = (action[1] << 8) | action[2];
+            s64 value;
+            // a failed expression keeps whatever it collected
+            gdbAgentEval(&action[3], len, thread, gdbTraceCollectMemory, &value);
+            offset += 3 + len;
+        }
+    }
+}
+
+static void gdbCommitTraceFrame() {
+    u32 len = gdbTraceStagingLength;
+    gdbTraceWriteU32(&gdbTraceStaging[2], len - GDB_TRACE_FRAME_HEADER_SIZE);
+
+    if (!gdbMakeTraceRoom(len)) {
+        gdbEndTrace(GDBTraceStopReasonFull, 0);
+        return;
+    }
+
+    bcopy(gdbTraceStaging, &gdbTraceBuffer[gdbTraceTail], len);
+    gdbTraceTail += len;
+    ++gdbTraceFrameCount;
+    ++gdbTraceCreated;
+}
+
+void gdbCollectTraceFrames(u32 addr, OSThread* thread) {
+    int i;
+
+    for (i = 0; i < GDB_MAX_TRACEPOINTS && gdbIsTracing(); ++i) {
+        struct GDBTracepoint* tracepoint = &gdbTracepoints[i];
+
+        if (!tracepoint->number || !tracepoint->isEnabled || tracepoint->addr != addr) {
+            continue;
+        }
+
+        if (tracepoint->conditionLength) {
+            s64 value;
+
+            if (gdbAgentEval(tracepoint->condition, tracepoint->conditionLength, thread, NULL, &value) != GDBAgentResultOK || !value) {
+                continue;
+            }
+        }
+
+        ++tracepoint->hitCount;
+
+        gdbTraceStagingLength = GDB_TRACE_FRAME_HEADER_SIZE;
+        gdbTraceStaging[0] = (u8)(tracepoint->number >> 8);
+        gdbTraceStaging[1] = (u8)tracepoint->number;
+
+        if (tracepoint->collectRegisters) {
+            u8* target = gdbTraceReserve(1 + GDB_REGISTER_BLOCK_SIZE);
+            target[0] = 'R';
+            gdbSaveRegisters(thread, &target[1]);
+        }
+
+        gdbTraceRunActions(tracepoint, thread);
+        gdbCommitTraceFrame();
+
+        if (tracepoint->passCount && tracepoint->hitCount >= tracepoint->passCount) {
+            gdbEndTrace(GDBTraceStopReasonPassCount, tracepoint->number);
+        }
+    }
+}
+
+/**
+ * Finds a block of type in the frame at offset
+ * @param after continue searching after a previously found block
+ */
+static u8* gdbFindTraceBlock(u32 offset, char type, u8* after) {
+    u8* frame = &gdbTraceBuffer[offset];
+    u8* end = frame + gdbTraceFrameSize(offset);
+    u8* block = frame + GDB_TRACE_FRAME_HEADER_SIZE;
+
+    while (block < end) {
+        u8* current = block;
+
+        if (*block == 'R') {
+            block += 1 + GDB_REGISTER_BLOCK_SIZE;
+        } else if (*block == 'M') {
+            block += GDB_TRACE_MEMORY_HEADER_SIZE + ((block[9] << 8) | block[10]);
+        } else {
+            break;
+        }
+
+        if (*current == type && current > after) {
+            return current;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * The pc of a frame comes from its registers when they were 
+ * collected otherwise it is the address of the tracepoint
+ */
+static u32 gdbTraceFramePC(u32 offset) {
+    u32 number = (gdbTraceBuffer[offset] << 8) | gdbTraceBuffer[offset + 1];
+    u8* registers = gdbFindTraceBlock(offset, 'R', NULL);
+
+    if (registers) {
+        return gdbTraceReadU32(registers + 1 + gdbRegisterOffset(GDB_REGISTER_PC) + 4);
+    }
+
+    int i;
+    for (i = 0; i < GDB_MAX_TRACEPOINTS; ++i) {
+        if (gdbTracepoints[i].number == number) {
+            return gdbTracepoints[i].addr;
+        }
+    }
+
+    return 0;
+}
+
+int gdbFindTraceFrame(char* src, char* packetEnd) {
+    enum {
+        GDBFrameSearchNumber,
+        GDBFrameSearchPC,
+        GDBFrameSearchTracepoint,
+        GDBFrameSearchRange,
+        GDBFrameSearchOutside,
+    } search = GDBFrameSearchNumber;
+    u32 low = 0;
+    u32 high = 0;
+
+    if (strncmp(src, "pc:", strlen("pc:")) == 0) {
+        search = GDBFrameSearchPC;
+        gdbTraceParseHex(src + strlen("pc:"), packetEnd, &low);
+    } else if (strncmp(src, "tdp:", strlen("tdp:")) == 0) {
+        search = GDBFrameSearchTracepoint;
+        gdbTraceParseHex(src + strlen("tdp:"), packetEnd, &low);
+    } else if (strncmp(src, "range:", strlen("range:")) == 0) {
+        search = GDBFrameSearchRange;
+        src = gdbTraceParseHex(src + strlen("range:"), packetEnd, &low);
+        gdbTraceParseHex(src + 1, packetEnd, &high);
+    } else if (strncmp(src, "outside:", strlen("outside:")) == 0) {
+        search = GDBFrameSearchOutside;
+        src = gdbTraceParseHex(src + strlen("outside:"), packetEnd, &low);
+        gdbTraceParseHex(src + 1, packetEnd, &high);
+    } else {
+        gdbTraceParseHex(src, packetEnd, &low);
+    }
+
+    // searches start after the selected frame
+    int first = search == GDBFrameSearchNumber ? 0 : gdbSelectedFrame + 1;
+    u32 offset = gdbTraceHead;
+    int frame;
+
+    gdbSelectedFrame = GDB_NO_TRACE_FRAME;
+
+    for (frame = 0; frame < gdbTraceFrameCount; ++frame, offset = gdbNextTraceFrame(offset)) {
+        if (frame < first) {
+            continue;
+        }
+
+        int isMatch;
+        u32 pc;
+
+        switch (search) {
+            case GDBFrameSearchNumber:
+                isMatch = frame == low;
+                break;
+            case GDBFrameSearchTracepoint:
+                isMatch = ((gdbTraceBuffer[offset] << 8) | gdbTraceBuffer[offset + 1]) == low;
+                break;
+            default:
+                pc = gdbTraceFramePC(offset);
+
+                if (search == GDBFrameSearchPC) {
+                    isMatch = pc == low;
+                } else {
+                    isMatch = (pc >= low && pc <= high) == (search == GDBFrameSearchRange);
+                }
+                break;
+        }
+
+        if (isMatch) {
+            gdbSelectedFrame = frame;
+            gdbSelectedFrameOffset = offset;
+            break;
+        }
+    }
+
+    return gdbSelectedFrame;
+}
+
+int gdbIsTraceFrameSelected() {
+    return gdbSelectedFrame != GDB_NO_TRACE_FRAME;
+}
+
+u32 gdbTraceFrameTracepoint() {
+    return (gdbTraceBuffer[gdbSelectedFrameOffset] << 8) | gdbTraceBuffer[gdbSelectedFrameOffset + 1];
+}
+
+void gdbReplyTraceFrameRegister(struct GDBReply* reply, int regNum) {
+    u8* registers = gdbFindTraceBlock(gdbSelectedFrameOffset, 'R', NULL);
+    u32 size = gdbRegisterSize(regNum);
+
+    if (registers) {
+        gdbReplyHexBytes(reply, registers + 1 + gdbRegisterOffset(regNum), size);
+    } else if (regNum == GDB_REGISTER_PC) {
+        gdbReplyHex64(reply, gdbTraceFramePC(gdbSelectedFrameOffset));
+    } else {
+        while (size > 0) {
+            gdbReplyString(reply, "xx");
+            --size;
+        }
+    }
+}
+
+u32 gdbReplyTraceFrameMemory(struct GDBReply* reply, u32 addr, u32 len, int isBinary) {
+    u32 written = 0;
+
+    while (len > 0) {
+        u8* block = gdbFindTraceBlock(gdbSelectedFrameOffset, 'M', NULL);
+
+        // find the block holding addr
+        while (block) {
+            u32 blockAddr = gdbTraceReadU32(&block[5]);
+            u32 blockLen = (block[9] << 8) | block[10];
+
+            if (addr >= blockAddr && addr < blockAddr + blockLen) {
+                break;
+            }
+
+            block = gdbFindTraceBlock(gdbSelectedFrameOffset, 'M', block);
+        }
+
+        if (!block) {
+            break;
+        }
+
+        u32 blockOffset = addr - gdbTraceReadU32(&block[5]);
+        u32 chunk = ((block[9] << 8) | block[10]) - blockOffset;
+
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        if (isBinary) {
+            gdbReplyBinary(reply, &block[GDB_TRACE_MEMORY_HEADER_SIZE + blockOffset], chunk);
+        } else {
+            gdbReplyHexBytes(reply, &block[GDB_TRACE_MEMORY_HEADER_SIZE + blockOffset], chunk);
+        }
+
+        addr += chunk;
+        len -= chunk;
+        written += chunk;
+    }
+
+    return written;
+}
+
+static u32 gdbTraceBufferUsed() {
+    if (gdbTraceWrap) {
+        return gdbTraceWrap - gdbTraceHead + gdbTraceTail;
+    }
+
+    return gdbTraceTail - gdbTraceHead;
+}
+
+void gdbReplyTraceStatus(struct GDBReply* reply) {
+    if (gdbIsTracing()) {
+        gdbReplyString(reply, "T1");
+    } else {
+        switch (gdbTraceStopReason) {
+            case GDBTraceStopReasonNotRun:
+                gdbReplyString(reply, "T0;tnotrun:0");
+                break;
+            case GDBTraceStopReasonStop:
+                gdbReplyString(reply, "T0;tstop:0");
+                break;
+            case GDBTraceStopReasonFull:
+                gdbReplyString(reply, "T0;tfull:0");
+                break;
+            case GDBTraceStopReasonPassCount:
+                gdbReplyString(reply, "T0;tpasscount:");
+                gdbReplyHexValue(reply, gdbTraceStopTracepoint);
+                break;
+        }
+    }
+
+    gdbReplyString(reply, ";tframes:");
+    gdbReplyHexValue(reply, gdbTraceFrameCount);
+    gdbReplyString(reply, ";tcreated:");
+    gdbReplyHexValue(reply, gdbTraceCreated);
+    gdbReplyString(reply, ";tfree:");
+    gdbReplyHexValue(reply, GDB_TRACE_BUFFER_SIZE - gdbTraceBufferUsed());
+    gdbReplyString(reply, ";tsize:");
+    gdbReplyHexValue(reply, GDB_TRACE_BUFFER_SIZE);
+    gdbReplyString(reply, (gdbTraceFlags & GDB_TRACE_IS_CIRCULAR) ? ";circular:1" : ";circular:0");
+    gdbReplyString(reply, ";disconn:0");
+}
+
+void gdbReplyTraceBuffer(struct GDBReply* reply, u32 offset, u32 len) {
+    u32 used = gdbTraceBufferUsed();
+
+    if (offset >= used) {
+        gdbReplyChar(reply, 'l');
+        return;
+    }
+
+    if (len > used - offset) {
+        len = used - offset;
+    }
+
+    u32 firstLength = (gdbTraceWrap ? gdbTraceWrap : gdbTraceTail) - gdbTraceHead;
+
+    if (offset < firstLength) {
+        u32 chunk = firstLength - offset;
+
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        gdbReplyHexBytes(reply, &gdbTraceBuffer[gdbTraceHead + offset], chunk);
+        offset += chunk;
+        len -= chunk;
+    }
+
+    if (len > 0) {
+        // the part that wrapped to the start of the buffer
+        gdbReplyHexBytes(reply, &gdbTraceBuffer[offset - firstLength], len);
+    }
+}
+
+int gdbReplyTracepoint(struct GDBReply* reply, int index) {
+    if (index >= GDB_MAX_TRACEPOINTS || !gdbTracepoints[index].number) {
+        return 0;
+    }
+
+    struct GDBTracepoint* tracepoint = &gdbTracepoints[index];
+
+    gdbReplyChar(reply, 'T');
+    gdbReplyHexValue(reply, tracepoint->number);
+    gdbReplyChar(reply, ':');
+    gdbReplyHexValue(reply, tracepoint->addr);
+    gdbReplyString(reply, tracepoint->isEnabled ? ":E:0:" : ":D:0:");
+    gdbReplyHexValue(reply, tracepoint->passCount);
+
+    if (tracepoint->conditionLength) {
+        gdbReplyString(reply, ":X");
+        gdbReplyHexValue(reply, tracepoint->conditionLength);
+        gdbReplyChar(reply, ',');
+        gdbReplyHexBytes(reply, tracepoint->condition, tracepoint->conditionLength);
+    }
+
+    return 1;
+}
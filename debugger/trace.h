@@ -0,0 +1,90 @@
+#ifndef __LIBULTRA_GDB_TRACE_H
+#define __LIBULTRA_GDB_TRACE_H
+
+#include <ultra64.h>
+#include "serial.h"
+#include "reply.h"
+
+#ifndef GDB_TRACE_BUFFER_SIZE
+#define GDB_TRACE_BUFFER_SIZE   0x10000
+#endif
+
+#define GDB_MAX_TRACEPOINTS     16
+// the most a single hit can collect
+#define GDB_TRACE_FRAME_SIZE    0x800
+#define GDB_TRACE_ACTIONS_SIZE  128
+#define GDB_TRACE_CONDITION_SIZE 64
+
+#define GDB_NO_TRACE_FRAME      -1
+
+/**
+ * Clears all tracepoints and collected frames for QTinit
+ */
+void gdbClearTracepoints();
+/**
+ * Adds a tracepoint or an action to a tracepoint from a QTDP packet
+ * @param src the text after "QTDP:"
+ */
+enum GDBError gdbDefineTracepoint(char* src, char* packetEnd);
+/**
+ * Places a breakpoint at each enabled tracepoint and empties 
+ * the trace buffer. Like Z0 the breakpoints are staged until
+ * they are committed
+ */
+enum GDBError gdbStartTrace();
+void gdbStopTrace();
+int gdbIsTracing();
+/**
+ * Checks if the breakpoint at addr belongs to a running tracepoint
+ */
+int gdbIsTracepoint(u32 addr);
+/**
+ * When circular is set the oldest frames are dropped to make room
+ * for new frames instead of stopping the trace when the buffer fills
+ */
+void gdbSetTraceCircular(int circular);
+/**
+ * Records a frame for every tracepoint at addr then checks 
+ * the pass counts. Called while thread is stopped at addr
+ */
+void gdbCollectTraceFrames(u32 addr, OSThread* thread);
+
+/**
+ * Selects a frame from the text after "QTFrame:". Registers and
+ * memory are read from the selected frame until it is cleared
+ * @returns the selected frame or GDB_NO_TRACE_FRAME
+ */
+int gdbFindTraceFrame(char* src, char* packetEnd);
+int gdbIsTraceFrameSelected();
+/**
+ * The tracepoint number of the selected frame
+ */
+u32 gdbTraceFrameTracepoint();
+/**
+ * Writes a register of the selected frame. Registers that weren't
+ * collected are written as unavailable
+ */
+void gdbReplyTraceFrameRegister(struct GDBReply* reply, int regNum);
+/**
+ * Writes as much memory from the selected frame as was collected
+ * starting at addr. Returns the number of bytes written
+ */
+u32 gdbReplyTraceFrameMemory(struct GDBReply* reply, u32 addr, u32 len, int isBinary);
+
+/**
+ * Writes the body of a qTStatus reply
+ */
+void gdbReplyTraceStatus(struct GDBReply* reply);
+/**
+ * Writes the raw frames in the buffer starting with the oldest. 
+ * Frames use the same layout as gdbserver so tsave can store them
+ * directly. Writes 'l' once offset is past the end
+ */
+void gdbReplyTraceBuffer(struct GDBReply* reply, u32 offset, u32 len);
+/**
+ * Writes the definition of a tracepoint for qTfP and qTsP
+ * @returns 0 if index is past the last tracepoint
+ */
+int gdbReplyTracepoint(struct GDBReply* reply, int index);
+
+#endif
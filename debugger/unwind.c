@@ -0,0 +1,206 @@
+#include "unwind.h"
+#include "debugger.h"
+
+#define GDB_INSTR_ADDIU_SP      0x27BD0000
+#define GDB_INSTR_DADDIU_SP     0x67BD0000
+#define GDB_INSTR_SW_RA         0xAFBF0000
+#define GDB_INSTR_SD_RA         0xFFBF0000
+#define GDB_INSTR_JR_RA         0x03E00008
+#define GDB_INSTR_OP_SP_MASK    0xFFFF0000
+
+#define GDB_OPCODE(instr)       ((instr) >> 26)
+#define GDB_OPCODE_SPECIAL      0x00
+#define GDB_OPCODE_REGIMM       0x01
+#define GDB_OPCODE_JAL          0x03
+#define GDB_FUNCT_JALR          0x09
+// bltzal, bgezal, bltzall and bgezall
+#define GDB_IS_REGIMM_LINK(instr)   ((((instr) >> 16) & 0x1C) == 0x10)
+
+#define GDB_PAGE_SIZE           0x1000
+
+#define GDB_NO_RA_SAVE          -1
+
+struct GDBFrameInfo {
+    // where the function starts if the scan stopped at the end of the previous one
+    u32 start;
+    u32 frameSize;
+    // where the low word of ra is saved relative to sp or GDB_NO_RA_SAVE
+    s32 raOffset;
+};
+
+/**
+ * @returns NULL if the word at addr can't be read
+ */
+static u32* gdbUnwindTranslate(u32 addr) {
+    if (addr & 0x3) {
+        return NULL;
+    }
+
+    u32* result = gdbTranslateAddr((void*)addr);
+
+    if (!result || gdbReadableLength(result, sizeof(u32)) < sizeof(u32)) {
+        return NULL;
+    }
+
+    return result;
+}
+
+static int gdbIsStackRestore(u32* instr) {
+    return (*instr & GDB_INSTR_OP_SP_MASK) == GDB_INSTR_ADDIU_SP && (s16)*instr > 0;
+}
+
+/**
+ * Scans the instructions before pc for the prologue of the function
+ * holding pc. Only instructions that already ran are looked at so a
+ * pc partway through the prologue gets the part of the frame set up
+ * so far
+ * @param skipEarlyReturns treat a jr ra that restores sp as an early 
+ *  return instead of the end of the previous function
+ * @returns 0 if the prologue couldn't be found
+ */
+static int gdbScanPrologue(u32 pc, int skipEarlyReturns, struct GDBFrameInfo* frame) {
+    u32* instr = gdbUnwindTranslate(pc);
+    u32 addr = pc;
+    int i;
+
+    frame->start = 0;
+    frame->frameSize = 0;
+    frame->raOffset = GDB_NO_RA_SAVE;
+
+    if (!instr) {
+        return 0;
+    }
+
+    for (i = 0; i < GDB_UNWIND_MAX_SCAN; ++i) {
+        if ((addr & (GDB_PAGE_SIZE - 1)) == 0) {
+            // each page is checked once as the scan enters it
+            instr = gdbUnwindTranslate(addr - sizeof(u32));
+
+            if (!instr) {
+                return 0;
+            }
+        } else {
+            --instr;
+        }
+
+        addr -= sizeof(u32);
+
+        u32 op = *instr & GDB_INSTR_OP_SP_MASK;
+
+        if ((op == GDB_INSTR_ADDIU_SP || op == GDB_INSTR_DADDIU_SP) && (s16)*instr < 0) {
+            frame->frameSize = -(s16)*instr;
+            return 1;
+        } else if (op == GDB_INSTR_SW_RA) {
+            frame->raOffset = (s16)*instr;
+        } else if (op == GDB_INSTR_SD_RA) {
+            // big endian so the low word of ra is the second word
+            frame->raOffset = (s16)*instr + sizeof(u32);
+        } else if (*instr == GDB_INSTR_JR_RA) {
+            // an early return restores sp in the instruction before
+            // jr or in its delay slot. So does the end of a previous
+            // function with a frame
+            u32 pageOffset = addr & (GDB_PAGE_SIZE - 1);
+            int isEpilogue = (pageOffset != GDB_PAGE_SIZE - sizeof(u32) && gdbIsStackRestore(instr + 1)) ||
+                (pageOffset != 0 && gdbIsStackRestore(instr - 1));
+
+            if (!isEpilogue || !skipEarlyReturns) {
+                // skip the delay slot
+                frame->start = addr + sizeof(u32) * 2;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Checks that the instruction before the delay slot of a return
+ * address is a call
+ */
+static int gdbIsCallSite(u32 returnAddress) {
+    u32* instr = gdbUnwindTranslate(returnAddress - sizeof(u32) * 2);
+
+    if (!instr) {
+        return 0;
+    }
+
+    switch (GDB_OPCODE(*instr)) {
+        case GDB_OPCODE_JAL:
+            return 1;
+        case GDB_OPCODE_SPECIAL:
+            return (*instr & 0x3F) == GDB_FUNCT_JALR;
+        case GDB_OPCODE_REGIMM:
+            return GDB_IS_REGIMM_LINK(*instr);
+    }
+
+    return 0;
+}
+
+/**
+ * Finds the caller of the function holding pc and the sp of the caller
+ * @param ra the ra register, only valid in the innermost frame
+ * @returns 0 if the return address found isn't after a call
+ */
+static int gdbUnwindFrame(u32 pc, u32 ra, int skipEarlyReturns, u32* sp, u32* caller) {
+    struct GDBFrameInfo frame;
+
+    if (!gdbScanPrologue(pc, skipEarlyReturns, &frame)) {
+        return 0;
+    }
+
+    if (frame.raOffset != GDB_NO_RA_SAVE) {
+        u32* savedRA = gdbUnwindTranslate(*sp + frame.raOffset);
+
+        if (!savedRA) {
+            return 0;
+        }
+
+        *caller = *savedRA;
+    } else if (ra && !(frame.start && ra - sizeof(u32) * 2 >= frame.start && ra - sizeof(u32) * 2 < pc)) {
+        // ra hasn't been saved yet or the function is a leaf. A leaf 
+        // doesn't call anything so ra can't point back into it
+        *caller = ra;
+    } else {
+        return 0;
+    }
+
+    if (!gdbIsCallSite(*caller)) {
+        return 0;
+    }
+
+    *sp += frame.frameSize;
+    return 1;
+}
+
+u32 gdbUnwindStack(OSThread* thread, u32* returnAddresses, u32 maxFrames) {
+    u32 pc = thread->context.pc;
+    u32 sp = (u32)thread->context.sp;
+    u32 ra = (u32)thread->context.ra;
+    u32 count = 0;
+
+    while (count < maxFrames && !(sp & 0x7)) {
+        u32 caller;
+        u32 callerSP = sp;
+
+        // a jr ra that restores sp is either the end of the function
+        // before this one or an early return in this function. The 
+        // first only works if the return address follows a call
+        if (!gdbUnwindFrame(pc, ra, 0, &callerSP, &caller)) {
+            callerSP = sp;
+
+            if (!gdbUnwindFrame(pc, ra, 1, &callerSP, &caller)) {
+                break;
+            }
+        }
+
+        returnAddresses[count++] = caller;
+        sp = callerSP;
+        // only the innermost function can have ra unsaved
+        ra = 0;
+        // the scan for the caller starts at its call
+        pc = caller - sizeof(u32) * 2;
+    }
+
+    return count;
+}
@@ -0,0 +1,22 @@
+#ifndef __LIBULTRA_GDB_UNWIND_H
+#define __LIBULTRA_GDB_UNWIND_H
+
+#include <ultra64.h>
+
+// instructions searched backwards for a function's prologue
+#ifndef GDB_UNWIND_MAX_SCAN
+#define GDB_UNWIND_MAX_SCAN     512
+#endif
+
+/**
+ * Finds the return addresses on the stack of a thread that isn't
+ * running by scanning backwards from each pc for the addiu that
+ * allocates the frame and the sw that saves ra. Every read is
+ * checked first so a corrupt stack ends the walk instead of faulting.
+ * Functions that are too large or set up their frame some other way
+ * end the walk early
+ * @returns the number of return addresses written
+ */
+u32 gdbUnwindStack(OSThread* thread, u32* returnAddresses, u32 maxFrames);
+
+#endif
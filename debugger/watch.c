@@ -0,0 +1,320 @@
+#include "watch.h"
+#include "step.h"
+#include "breakpoint.h"
+#include "libultra.h"
+
+#define GDB_TLB_VALID       0x2
+#define GDB_TLB_DIRTY       0x4
+#define GDB_TLB_PFN(lo)     (((lo) >> 6) << 12)
+
+#define GDB_EXC_MOD         1
+#define GDB_EXC_TLBL        2
+#define GDB_EXC_TLBS        3
+
+struct GDBTLBEntry {
+    u32 entryHi;
+    u32 entryLo0;
+    u32 entryLo1;
+    u32 pageMask;
+};
+
+/**
+ * A page the watch engine changed. Pages are found again each 
+ * time the watches are rearmed in case the game remapped the TLB
+ */
+struct GDBTLBPage {
+    u32 vaddr;
+    u32 pageSize;
+    u32 originalLo;
+    u8 index;
+    u8 isOdd;
+};
+
+s32 __gdbProbeTLB(u32 vaddr);
+void __gdbReadTLB(u32 index, struct GDBTLBEntry* entry);
+void __gdbWriteTLB(u32 index, struct GDBTLBEntry* entry);
+
+static struct GDBTLBWatch gdbTLBWatches[GDB_MAX_TLB_WATCHES];
+static struct GDBTLBPage gdbTLBPages[GDB_MAX_TLB_WATCH_PAGES];
+static u32 gdbTLBPageCount;
+
+static u32 gdbTLBPageSize(u32 pageMask) {
+    // the mask covers an even and odd page pair
+    return ((pageMask | 0x1FFF) + 1) >> 1;
+}
+
+static struct GDBTLBPage* gdbFindTLBPage(u32 vaddr) {
+    int i;
+    for (i = 0; i < gdbTLBPageCount; ++i) {
+        if (vaddr - gdbTLBPages[i].vaddr < gdbTLBPages[i].pageSize) {
+            return &gdbTLBPages[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Protects the page holding vaddr. Returns 0 if the address
+ * isn't mapped or there are too many pages
+ */
+static int gdbProtectTLBPage(u32 vaddr, char type) {
+    struct GDBTLBPage* page = gdbFindTLBPage(vaddr);
+    struct GDBTLBEntry entry;
+    s32 index = __gdbProbeTLB(vaddr);
+
+    if (index < 0) {
+        return 0;
+    }
+
+    __gdbReadTLB(index, &entry);
+    u32 pageSize = gdbTLBPageSize(entry.pageMask);
+    int isOdd = (vaddr & pageSize) != 0;
+    u32* lo = isOdd ? &entry.entryLo1 : &entry.entryLo0;
+
+    if (!page) {
+        if (gdbTLBPageCount == GDB_MAX_TLB_WATCH_PAGES || !(*lo & GDB_TLB_VALID)) {
+            return 0;
+        }
+
+        page = &gdbTLBPages[gdbTLBPageCount++];
+        page->vaddr = vaddr & ~(pageSize - 1);
+        page->pageSize = pageSize;
+        page->originalLo = *lo;
+        page->index = (u8)index;
+        page->isOdd = (u8)isOdd;
+    }
+
+    // write watches only need stores to fault
+    *lo &= type == '2' ? ~GDB_TLB_DIRTY : ~GDB_TLB_VALID;
+    __gdbWriteTLB(index, &entry);
+
+    return 1;
+}
+
+static int gdbProtectTLBWatch(struct GDBTLBWatch* watch) {
+    u32 page = watch->addr;
+    u32 end = watch->addr + watch->length;
+
+    while (page < end) {
+        if (!gdbProtectTLBPage(page, watch->type)) {
+            return 0;
+        }
+
+        page = (page | (gdbFindTLBPage(page)->pageSize - 1)) + 1;
+    }
+
+    return 1;
+}
+
+void gdbSuspendTLBWatches() {
+    u32 saveMask = __osDisableInt();
+
+    while (gdbTLBPageCount > 0) {
+        struct GDBTLBPage* page = &gdbTLBPages[--gdbTLBPageCount];
+        struct GDBTLBEntry entry;
+        __gdbReadTLB(page->index, &entry);
+
+        if (page->isOdd) {
+            entry.entryLo1 = page->originalLo;
+        } else {
+            entry.entryLo0 = page->originalLo;
+        }
+
+        __gdbWriteTLB(page->index, &entry);
+    }
+
+    __osRestoreInt(saveMask);
+}
+
+void gdbRearmTLBWatches() {
+    int i;
+
+    gdbSuspendTLBWatches();
+
+    u32 saveMask = __osDisableInt();
+
+    for (i = 0; i < GDB_MAX_TLB_WATCHES; ++i) {
+        if (gdbTLBWatches[i].type) {
+            gdbProtectTLBWatch(&gdbTLBWatches[i]);
+        }
+    }
+
+    __osRestoreInt(saveMask);
+}
+
+int gdbInsertTLBWatch(u32 addr, u32 length, char type) {
+    struct GDBTLBWatch* watch = NULL;
+    int i;
+
+    for (i = 0; i < GDB_MAX_TLB_WATCHES; ++i) {
+        if (!gdbTLBWatches[i].type) {
+            watch = &gdbTLBWatches[i];
+            break;
+        }
+    }
+
+    if (!watch || !length) {
+        return 0;
+    }
+
+    watch->addr = addr;
+    watch->length = length;
+    watch->type = type;
+
+    u32 saveMask = __osDisableInt();
+    int result = gdbProtectTLBWatch(watch);
+    __osRestoreInt(saveMask);
+
+    if (!result) {
+        watch->type = 0;
+        // put back any pages the failed watch protected
+        gdbRearmTLBWatches();
+    }
+
+    return result;
+}
+
+void gdbRemoveTLBWatch(u32 addr, u32 length, char type) {
+    int i;
+
+    for (i = 0; i < GDB_MAX_TLB_WATCHES; ++i) {
+        struct GDBTLBWatch* watch = &gdbTLBWatches[i];
+
+        if (watch->type == type && watch->addr == addr && watch->length == length) {
+            watch->type = 0;
+            gdbRearmTLBWatches();
+            return;
+        }
+    }
+}
+
+void gdbRemoveAllTLBWatches() {
+    bzero(gdbTLBWatches, sizeof(gdbTLBWatches));
+    gdbSuspendTLBWatches();
+}
+
+int gdbIsTLBWatchFault(OSThread* thread) {
+    u32 excCode = (thread->context.cause >> 2) & 0x1f;
+
+    return (thread->flags & OS_FLAG_FAULT) && 
+        excCode >= GDB_EXC_MOD && excCode <= GDB_EXC_TLBS && 
+        gdbFindTLBPage(thread->context.badvaddr);
+}
+
+struct GDBTLBWatch* gdbFindTLBWatchHit(OSThread* thread) {
+    if (!gdbIsTLBWatchFault(thread)) {
+        return NULL;
+    }
+
+    u32 pc = thread->context.pc;
+
+    if (thread->context.cause & 0x80000000) {
+        // the access is in a delay slot
+        pc += 4;
+    }
+
+    u32 addr;
+    u32 size = gdbGetMemoryAccess(thread, gdbReadOriginalInstruction(pc), &addr);
+
+    if (!size) {
+        // an instruction fetch from the page
+        return NULL;
+    }
+
+    int isStore = ((thread->context.cause >> 2) & 0x1f) != GDB_EXC_TLBL;
+    int i;
+
+    for (i = 0; i < GDB_MAX_TLB_WATCHES; ++i) {
+        struct GDBTLBWatch* watch = &gdbTLBWatches[i];
+
+        if (!watch->type || (watch->type == '2' && !isStore) || (watch->type == '3' && isStore)) {
+            continue;
+        }
+
+        if (addr < watch->addr + watch->length && watch->addr < addr + size) {
+            return watch;
+        }
+    }
+
+    return NULL;
+}
+
+void* gdbTranslateWatchedAddr(u32 addr) {
+    struct GDBTLBPage* page = gdbFindTLBPage(addr);
+
+    if (!page) {
+        return NULL;
+    }
+
+    return (void*)PHYS_TO_K0(GDB_TLB_PFN(page->originalLo) + (addr - page->vaddr));
+}
+
+/**
+ * TLB access has to be done with cop0 instructions. EntryHi is
+ * restored after each call since it holds the current ASID
+ */
+asm(
+".set noreorder\n"
+".global __gdbProbeTLB\n"
+".balign 4\n"
+"__gdbProbeTLB:\n"
+    "mfc0 $t0, $10\n"
+    "andi $t1, $t0, 0xff\n"
+    "li $t2, 0xffffe000\n"
+    "and $a0, $a0, $t2\n"
+    "or $a0, $a0, $t1\n"
+    "mtc0 $a0, $10\n"
+    "nop\n"
+    "nop\n"
+    "tlbp\n"
+    "nop\n"
+    "nop\n"
+    "mfc0 $v0, $0\n"
+    "mtc0 $t0, $10\n"
+    "jr $ra\n"
+    "nop\n"
+
+".global __gdbReadTLB\n"
+".balign 4\n"
+"__gdbReadTLB:\n"
+    "mfc0 $t0, $10\n"
+    "mtc0 $a0, $0\n"
+    "nop\n"
+    "tlbr\n"
+    "nop\n"
+    "nop\n"
+    "nop\n"
+    "mfc0 $t1, $10\n"
+    "sw $t1, 0($a1)\n"
+    "mfc0 $t1, $2\n"
+    "sw $t1, 4($a1)\n"
+    "mfc0 $t1, $3\n"
+    "sw $t1, 8($a1)\n"
+    "mfc0 $t1, $5\n"
+    "sw $t1, 12($a1)\n"
+    "mtc0 $t0, $10\n"
+    "jr $ra\n"
+    "nop\n"
+
+".global __gdbWriteTLB\n"
+".balign 4\n"
+"__gdbWriteTLB:\n"
+    "mfc0 $t0, $10\n"
+    "mtc0 $a0, $0\n"
+    "lw $t1, 0($a1)\n"
+    "mtc0 $t1, $10\n"
+    "lw $t1, 4($a1)\n"
+    "mtc0 $t1, $2\n"
+    "lw $t1, 8($a1)\n"
+    "mtc0 $t1, $3\n"
+    "lw $t1, 12($a1)\n"
+    "mtc0 $t1, $5\n"
+    "nop\n"
+    "tlbwi\n"
+    "nop\n"
+    "nop\n"
+    "mtc0 $t0, $10\n"
+    "jr $ra\n"
+    "nop\n"
+".set reorder\n"
+);
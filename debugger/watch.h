@@ -0,0 +1,55 @@
+#ifndef __LIBULTRA_GDB_WATCH_H
+#define __LIBULTRA_GDB_WATCH_H
+
+#include <ultra64.h>
+
+#define GDB_MAX_TLB_WATCHES         16
+// pages that can be protected at once
+#define GDB_MAX_TLB_WATCH_PAGES     16
+
+/**
+ * A watchpoint on memory mapped through the TLB. The pages holding
+ * it are marked invalid, or read only for write watches, so accesses 
+ * fault and can be checked against the watch list
+ * 
+ * Only memory the game maps with osMapTLB can be watched this way.
+ * Pages that hold code can't be watched since the debugger reads 
+ * instructions through their mapped address
+ */
+struct GDBTLBWatch {
+    u32 addr;
+    u32 length;
+    // '2' write, '3' read or '4' access the same as the Z packet
+    char type;
+};
+
+/**
+ * Adds a watch and protects its pages
+ * @returns 0 if the range isn't mapped through the TLB or there is no room
+ */
+int gdbInsertTLBWatch(u32 addr, u32 length, char type);
+void gdbRemoveTLBWatch(u32 addr, u32 length, char type);
+void gdbRemoveAllTLBWatches();
+/**
+ * Checks if thread faulted on a page protected for a watch
+ */
+int gdbIsTLBWatchFault(OSThread* thread);
+/**
+ * Finds the watch the faulting access of thread overlaps
+ * @returns NULL if the access missed every watch on the page
+ */
+struct GDBTLBWatch* gdbFindTLBWatchHit(OSThread* thread);
+/**
+ * Puts back the original TLB entries so a thread can step
+ * over an access to a protected page
+ */
+void gdbSuspendTLBWatches();
+void gdbRearmTLBWatches();
+/**
+ * The cached address of a protected page since osVirtualToPhysical
+ * can't translate pages marked invalid
+ * @returns NULL if addr isn't in a protected page
+ */
+void* gdbTranslateWatchedAddr(u32 addr);
+
+#endif
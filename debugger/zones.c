@@ -0,0 +1,184 @@
+#include "zones.h"
+#include "debugger.h"
+#include "libultra.h"
+
+struct GDBZoneBuffer {
+    // NULL until a thread claims the buffer. Buffers are never released
+    OSThread* owner;
+    OSId threadId;
+    // only the owner moves the head and only the debugger thread moves the tail
+    volatile u32 head;
+    volatile u32 tail;
+    // the owner counts drops and the debugger thread counts what it reported
+    // so neither has to stop the other to reset it
+    volatile u32 dropped;
+    u32 droppedSent;
+    struct GDBZoneEvent events[GDB_ZONE_BUFFER_SIZE];
+};
+
+static struct GDBZoneBuffer gdbZoneBuffers[GDB_ZONE_MAX_THREADS];
+// most events come from the thread that recorded the last one
+static struct GDBZoneBuffer* gdbLastZoneBuffer;
+static u8 gdbIsZoneRecording;
+
+static OSMesgQueue* gdbZoneFlushQueue;
+static OSMesg gdbZoneFlushMesg;
+
+static u32 gdbZoneMessage[GDB_ZONE_MESSAGE_HEADER + GDB_ZONE_MESSAGE_EVENTS * sizeof(struct GDBZoneEvent) / sizeof(u32)];
+
+/**
+ * @returns NULL if every buffer belongs to another thread
+ */
+static struct GDBZoneBuffer* gdbFindZoneBuffer() {
+    OSThread* thread = __osRunningThread;
+    struct GDBZoneBuffer* buffer = gdbLastZoneBuffer;
+
+    if (buffer && buffer->owner == thread) {
+        return buffer;
+    }
+
+    int i;
+    for (i = 0; i < GDB_ZONE_MAX_THREADS; ++i) {
+        if (gdbZoneBuffers[i].owner == thread) {
+            gdbLastZoneBuffer = &gdbZoneBuffers[i];
+            return &gdbZoneBuffers[i];
+        }
+    }
+
+    buffer = NULL;
+
+    u32 saveMask = __osDisableInt();
+    for (i = 0; i < GDB_ZONE_MAX_THREADS; ++i) {
+        if (!gdbZoneBuffers[i].owner) {
+            buffer = &gdbZoneBuffers[i];
+            buffer->threadId = thread->id;
+            buffer->owner = thread;
+            break;
+        }
+    }
+    __osRestoreInt(saveMask);
+
+    if (buffer) {
+        gdbLastZoneBuffer = buffer;
+    }
+
+    return buffer;
+}
+
+static void gdbRecordZoneEvent(enum GDBZoneEventType type, u32 id, u32 value) {
+    if (!gdbIsZoneRecording) {
+        return;
+    }
+
+    u32 time = osGetCount();
+    struct GDBZoneBuffer* buffer = gdbFindZoneBuffer();
+
+    if (!buffer) {
+        return;
+    }
+
+    u32 head = buffer->head;
+    u32 used = head - buffer->tail;
+
+    if (used == GDB_ZONE_BUFFER_SIZE) {
+        ++buffer->dropped;
+        return;
+    }
+
+    struct GDBZoneEvent* event = &buffer->events[head & (GDB_ZONE_BUFFER_SIZE - 1)];
+    event->time = time;
+    event->type = type;
+    event->id = id;
+    event->value = value;
+    buffer->head = head + 1;
+
+    if (used + 1 == GDB_ZONE_BUFFER_SIZE / 2 && gdbZoneFlushQueue) {
+        osSendMesg(gdbZoneFlushQueue, gdbZoneFlushMesg, OS_MESG_NOBLOCK);
+    }
+}
+
+void gdbZoneBegin(u32 id) {
+    gdbRecordZoneEvent(GDBZoneEventBegin, id, 0);
+}
+
+void gdbZoneEnd() {
+    gdbRecordZoneEvent(GDBZoneEventEnd, 0, 0);
+}
+
+void gdbCounter(u32 id, u32 value) {
+    gdbRecordZoneEvent(GDBZoneEventCounter, id, value);
+}
+
+void gdbStartZones() {
+    gdbIsZoneRecording = 1;
+}
+
+void gdbStopZones() {
+    gdbIsZoneRecording = 0;
+}
+
+int gdbIsRecordingZones() {
+    return gdbIsZoneRecording;
+}
+
+void gdbSetZoneFlushQueue(OSMesgQueue* queue, OSMesg msg) {
+    gdbZoneFlushQueue = queue;
+    gdbZoneFlushMesg = msg;
+}
+
+static enum GDBError gdbFlushZoneBuffer(struct GDBZoneBuffer* buffer) {
+    // events recorded while sending wait for the next flush
+    u32 head = buffer->head;
+    u32 tail = buffer->tail;
+    u32 dropped = buffer->dropped;
+
+    while (head != tail || dropped != buffer->droppedSent) {
+        u32 count = head - tail;
+
+        if (count > GDB_ZONE_MESSAGE_EVENTS) {
+            count = GDB_ZONE_MESSAGE_EVENTS;
+        }
+
+        u32 i;
+        struct GDBZoneEvent* target = (struct GDBZoneEvent*)&gdbZoneMessage[GDB_ZONE_MESSAGE_HEADER];
+        for (i = 0; i < count; ++i) {
+            target[i] = buffer->events[(tail + i) & (GDB_ZONE_BUFFER_SIZE - 1)];
+        }
+
+        tail += count;
+        buffer->tail = tail;
+
+        // read after the events so every event is older than it
+        u32 saveMask = __osDisableInt();
+        OSTime now = osGetTime();
+        gdbZoneMessage[0] = osGetCount();
+        __osRestoreInt(saveMask);
+
+        gdbZoneMessage[1] = (u32)(now >> 32);
+        gdbZoneMessage[2] = (u32)now;
+        gdbZoneMessage[3] = buffer->threadId;
+        gdbZoneMessage[4] = dropped - buffer->droppedSent;
+        buffer->droppedSent = dropped;
+
+        enum GDBError err = gdbSendMessage(
+            GDBDataTypeZones,
+            (char*)gdbZoneMessage,
+            GDB_ZONE_MESSAGE_HEADER * sizeof(u32) + count * sizeof(struct GDBZoneEvent)
+        );
+        if (err != GDBErrorNone) return err;
+    }
+
+    return GDBErrorNone;
+}
+
+enum GDBError gdbFlushZones() {
+    int i;
+    for (i = 0; i < GDB_ZONE_MAX_THREADS; ++i) {
+        if (gdbZoneBuffers[i].owner) {
+            enum GDBError err = gdbFlushZoneBuffer(&gdbZoneBuffers[i]);
+            if (err != GDBErrorNone) return err;
+        }
+    }
+
+    return GDBErrorNone;
+}
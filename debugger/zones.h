@@ -0,0 +1,56 @@
+#ifndef __LIBULTRA_GDB_ZONES_H
+#define __LIBULTRA_GDB_ZONES_H
+
+#include <ultra64.h>
+#include "serial.h"
+
+// threads that can record zones at once. Each gets its own buffer
+#ifndef GDB_ZONE_MAX_THREADS
+#define GDB_ZONE_MAX_THREADS    8
+#endif
+
+// events held for each thread until the debugger thread sends them. Must be a power of 2
+#ifndef GDB_ZONE_BUFFER_SIZE
+#define GDB_ZONE_BUFFER_SIZE    0x100
+#endif
+
+// events in each message sent to the host
+#define GDB_ZONE_MESSAGE_EVENTS 0x100
+
+enum GDBZoneEventType {
+    GDBZoneEventBegin,
+    GDBZoneEventEnd,
+    GDBZoneEventCounter,
+};
+
+/**
+ * time is the low 32 bits of the cpu counter when the event was
+ * recorded. value is only used by counters
+ */
+struct GDBZoneEvent {
+    u32 time;
+    u32 type;
+    u32 id;
+    u32 value;
+};
+
+/**
+ * A GDBDataTypeZones message is the u32 cpu counter and the u64
+ * osGetTime read together when it was sent, the u32 id of the thread
+ * that recorded the events and a u32 count of events the thread
+ * dropped since the last message followed by the events. The time
+ * places events on the host no matter how long ago the last message
+ * was. Each event only has to be sent within a counter period
+ */
+#define GDB_ZONE_MESSAGE_HEADER 5
+
+int gdbIsRecordingZones();
+// like gdbSetProfileFlushQueue, sent when any thread's buffer is half full
+void gdbSetZoneFlushQueue(OSMesgQueue* queue, OSMesg msg);
+/**
+ * Sends each thread's events as separate messages. Events a thread
+ * records while this runs wait for the next call
+ */
+enum GDBError gdbFlushZones();
+
+#endif
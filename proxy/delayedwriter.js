@@ -0,0 +1,40 @@
+// how long samples and events collect before they are written
+const WRITE_DELAY = 2000;
+
+/**
+ * Batches writes to an output file. After schedule is called, write
+ * runs once WRITE_DELAY later no matter how many times schedule is
+ * called in between. write should use the synchronous fs functions so
+ * flush can finish before the proxy exits
+ */
+function createDelayedWriter(write) {
+    let writeTimer = null;
+
+    function runWrite() {
+        writeTimer = null;
+
+        try {
+            write();
+        } catch (err) {
+            console.error(err);
+        }
+    }
+
+    return {
+        schedule: () => {
+            if (!writeTimer) {
+                writeTimer = setTimeout(runWrite, WRITE_DELAY);
+            }
+        },
+        flush: () => {
+            if (writeTimer) {
+                clearTimeout(writeTimer);
+                runWrite();
+            }
+        },
+    };
+}
+
+module.exports = {
+    createDelayedWriter,
+};
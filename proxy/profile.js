@@ -0,0 +1,232 @@
+const fs = require('fs');
+const { createDelayedWriter } = require('./delayedwriter');
+
+const SHT_SYMTAB = 2;
+const STT_FUNC = 2;
+
+/**
+ * Reads the function symbols from a 32 bit big endian elf file
+ * sorted by address
+ */
+function readFunctionSymbols(elfPath) {
+    const elf = fs.readFileSync(elfPath);
+
+    if (elf.toString('latin1', 1, 4) != 'ELF' || elf[4] != 1 || elf[5] != 2) {
+        throw new Error(`${elfPath} isn't a 32 bit big endian elf file`);
+    }
+
+    const sectionOffset = elf.readUInt32BE(0x20);
+    const sectionSize = elf.readUInt16BE(0x2E);
+    const sectionCount = elf.readUInt16BE(0x30);
+
+    function readSection(index) {
+        const start = sectionOffset + index * sectionSize;
+        return {
+            type: elf.readUInt32BE(start + 0x4),
+            offset: elf.readUInt32BE(start + 0x10),
+            size: elf.readUInt32BE(start + 0x14),
+            link: elf.readUInt32BE(start + 0x18),
+            entrySize: elf.readUInt32BE(start + 0x24),
+        };
+    }
+
+    const symbols = [];
+
+    for (let i = 0; i < sectionCount; ++i) {
+        const section = readSection(i);
+
+        if (section.type != SHT_SYMTAB) {
+            continue;
+        }
+
+        const strings = readSection(section.link);
+
+        for (let offset = section.offset; offset < section.offset + section.size; offset += section.entrySize) {
+            const info = elf[offset + 12];
+
+            if ((info & 0xF) != STT_FUNC) {
+                continue;
+            }
+
+            const nameStart = strings.offset + elf.readUInt32BE(offset);
+            const nameEnd = elf.indexOf(0, nameStart);
+
+            symbols.push({
+                name: elf.toString('latin1', nameStart, nameEnd),
+                address: elf.readUInt32BE(offset + 4),
+                size: elf.readUInt32BE(offset + 8),
+            });
+        }
+    }
+
+    symbols.sort((a, b) => a.address - b.address);
+
+    return symbols;
+}
+
+function findSymbol(symbols, pc) {
+    let min = 0;
+    let max = symbols.length;
+
+    while (min < max) {
+        const mid = (min + max) >> 1;
+
+        if (symbols[mid].address <= pc) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+
+    const symbol = symbols[min - 1];
+
+    // symbols without a size run until the next symbol
+    if (symbol && (!symbol.size || pc < symbol.address + symbol.size)) {
+        return symbol;
+    }
+
+    return null;
+}
+
+function hex(value) {
+    return '0x' + value.toString(16).padStart(8, '0');
+}
+
+// words before the return addresses in each sample
+const SAMPLE_HEADER = 3;
+// a return address is after the call and its delay slot
+const CALL_SIZE = 8;
+
+/**
+ * Collects GDBDataTypeProfile messages into a flat profile and
+ * optionally folded stacks for flame graph tools. Each message is a
+ * u32 sample rate and a u32 count of dropped samples followed by
+ * samples of the pc, the thread id, the number of return addresses
+ * and the return addresses
+ */
+function createProfile(outputPath, elfPath, stacksPath) {
+    const symbols = elfPath ? readFunctionSymbols(elfPath) : [];
+    // samples with the same thread and call stack are counted together
+    const stackCounts = new Map();
+    const threadCounts = new Map();
+    let total = 0;
+    let dropped = 0;
+    let rate = 0;
+
+    function nameOf(pc) {
+        const symbol = findSymbol(symbols, pc);
+        return symbol ? symbol.name : hex(pc);
+    }
+
+    function writeFlat(functionNames) {
+        const selfCounts = new Map();
+        const totalCounts = new Map();
+
+        stackCounts.forEach((count, key) => {
+            const names = functionNames.get(key);
+
+            selfCounts.set(names[0], (selfCounts.get(names[0]) || 0) + count);
+
+            // recursive functions are only counted once per sample
+            new Set(names).forEach(name => {
+                totalCounts.set(name, (totalCounts.get(name) || 0) + count);
+            });
+        });
+
+        const lines = [
+            `# ${total} samples at ${rate} per second, ${dropped} dropped`,
+        ];
+
+        Array.from(threadCounts.entries()).sort((a, b) => b[1] - a[1]).forEach(([threadId, count]) => {
+            lines.push(`# thread ${threadId.toString(16)}: ${count} samples`);
+        });
+
+        lines.push('');
+        lines.push('   self%  total%   samples  function');
+
+        Array.from(totalCounts.entries()).sort((a, b) => (selfCounts.get(b[0]) || 0) - (selfCounts.get(a[0]) || 0) || b[1] - a[1]).forEach(([name, count]) => {
+            const selfCount = selfCounts.get(name) || 0;
+            const selfPercent = (selfCount * 100 / total).toFixed(2) + '%';
+            const totalPercent = (count * 100 / total).toFixed(2) + '%';
+            lines.push(`${selfPercent.padStart(8)}${totalPercent.padStart(8)}  ${String(selfCount).padStart(8)}  ${name}`);
+        });
+
+        return lines;
+    }
+
+    function writeStacks(functionNames) {
+        const lines = [];
+
+        stackCounts.forEach((count, key) => {
+            const threadId = key.split(',')[0];
+            const names = functionNames.get(key).slice().reverse();
+            lines.push(`thread_${threadId};${names.join(';')} ${count}`);
+        });
+
+        return lines;
+    }
+
+    function writeFile(filename, lines) {
+        fs.writeFileSync(filename, lines.join('\n') + '\n');
+    }
+
+    // the whole profile is rewritten since it only grows with the number of unique stacks
+    const writer = createDelayedWriter(() => {
+        // innermost function first
+        const functionNames = new Map();
+
+        stackCounts.forEach((count, key) => {
+            const addresses = key.split(',').slice(1).map(value => parseInt(value, 16));
+            functionNames.set(key, addresses.map((address, index) => nameOf(index ? address - CALL_SIZE : address)));
+        });
+
+        if (outputPath) {
+            writeFile(outputPath, writeFlat(functionNames));
+        }
+
+        if (stacksPath) {
+            writeFile(stacksPath, writeStacks(functionNames));
+        }
+    });
+
+    return {
+        addSamples: (data) => {
+            // the last samples are sent after the profiler stops
+            rate = data.readUInt32BE(0) || rate;
+            dropped += data.readUInt32BE(4);
+
+            let offset = 8;
+
+            while (offset + SAMPLE_HEADER * 4 <= data.length) {
+                const pc = data.readUInt32BE(offset);
+                const threadId = data.readUInt32BE(offset + 4);
+                const frameCount = data.readUInt32BE(offset + 8);
+                const end = offset + (SAMPLE_HEADER + frameCount) * 4;
+
+                if (end > data.length) {
+                    break;
+                }
+
+                const key = [threadId, pc];
+
+                for (let frame = offset + SAMPLE_HEADER * 4; frame < end; frame += 4) {
+                    key.push(data.readUInt32BE(frame));
+                }
+
+                const keyString = key.map(value => value.toString(16)).join(',');
+                stackCounts.set(keyString, (stackCounts.get(keyString) || 0) + 1);
+                threadCounts.set(threadId, (threadCounts.get(threadId) || 0) + 1);
+                ++total;
+
+                offset = end;
+            }
+
+            writer.schedule();
+        },
+        flush: writer.flush,
+    };
+}
+
+module.exports = {
+    createProfile,
+};
@@ -2,11 +2,18 @@
 const path = require('path');
 const net = require('net');
 const fs = require('fs');
+const { createProfile } = require('./profile');
+const { createZoneTrace } = require('./zones');
 
 let verbose = false;
 let keepAlive = false;
 let eagerSerial = false;
 let controllerOutputPath = null;
+let profileOutputPath = null;
+let elfPath = null;
+let stacksOutputPath = null;
+let traceOutputPath = null;
+let zoneNamesPath = null;
 
 let prevArg = '';
 
@@ -16,7 +23,18 @@ const args = Array.from(process.argv).slice(2).filter(arg => {
     if (prevArg) {
         if (prevArg == '--controller-data') {
             controllerOutputPath = arg;
+        } else if (prevArg == '--profile') {
+            profileOutputPath = arg;
+        } else if (prevArg == '--elf') {
+            elfPath = arg;
+        } else if (prevArg == '--stacks') {
+            stacksOutputPath = arg;
+        } else if (prevArg == '--trace') {
+            traceOutputPath = arg;
+        } else if (prevArg == '--zone-names') {
+            zoneNamesPath = arg;
         }
+        prevArg = '';
     } else if (arg[0] == '-') {
         switch (arg) {
             case '-v':
@@ -32,6 +50,11 @@ const args = Array.from(process.argv).slice(2).filter(arg => {
                 eagerSerial = true;
                 break;
             case '--controller-data':
+            case '--profile':
+            case '--elf':
+            case '--stacks':
+            case '--trace':
+            case '--zone-names':
                 prevArg = arg;
                 break;
             default:
@@ -56,6 +79,16 @@ example
 
 arguments:
     -v --verbose  verbose logs
+    -k --keepalive  keep running after gdb disconnects
+    -e --eager  connect to the cart before gdb connects
+    --profile <file>  writes profiler samples from the cart as a flat profile
+    --elf <file>  the elf used to name functions in the profile
+    --stacks <file>  writes profiler call stacks as folded stacks for flame graphs
+    --trace <file>  writes zones and counters from the cart as a Chrome trace
+    --zone-names <file>  names for zone and counter ids, one id and name per line
+
+--profile, --stacks and --trace connect to the cart right away and keep
+the connection and the proxy running after gdb disconnects
 `);
     process.exit(1);
 }
@@ -223,6 +256,13 @@ server.listen(port, function() {
 const MESSAGE_TYPE_TEXT = 1;
 const MESSAGE_TYPE_GDB = 4;
 const MESSAGE_TYPE_CONTROLLER = 5;
+const MESSAGE_TYPE_PROFILE = 6;
+const MESSAGE_TYPE_ZONES = 7;
+
+const profile = (profileOutputPath || stacksOutputPath) ? createProfile(profileOutputPath, elfPath, stacksOutputPath) : null;
+const zoneTrace = traceOutputPath ? createZoneTrace(traceOutputPath, zoneNamesPath) : null;
+// the cart streams profiles and zones with or without gdb attached
+const isStreaming = !!(profile || zoneTrace);
 
 let serialPortPromise;
 let activeSocket;
@@ -259,6 +299,16 @@ function openSerialConnection() {
                         console.error(`Recieved controller data but no output file is specifie`);
                     }
                     break;
+                case MESSAGE_TYPE_PROFILE:
+                    if (profile) {
+                        profile.addSamples(message.data);
+                    }
+                    break;
+                case MESSAGE_TYPE_ZONES:
+                    if (zoneTrace) {
+                        zoneTrace.addEvents(message.data);
+                    }
+                    break;
             }
         };
 
@@ -271,20 +321,39 @@ function openSerialConnection() {
     }
 }
 
-if (eagerSerial) {
+function flushStreams() {
+    if (profile) {
+        profile.flush();
+    }
+
+    if (zoneTrace) {
+        zoneTrace.flush();
+    }
+}
+
+if (eagerSerial || isStreaming) {
     openSerialConnection();
 }
 
+if (isStreaming) {
+    // the proxy runs until stopped so write what hasn't been written yet
+    process.on('SIGINT', () => {
+        flushStreams();
+        process.exit(0);
+    });
+}
+
 function findMessageEnd(buffer) {
-    let messageEnd = buffer.indexOf('#');
+    let packetStart = buffer.indexOf('$');
     let interrupt = buffer.indexOf(0x03);
 
-    if (messageEnd != -1 && interrupt != -1) {
-        return Math.min(messageEnd + 3, interrupt + 1);
-    } else if (messageEnd != -1) {
-        return messageEnd + 3;
-    } else if (interrupt != -1) {
+    // binary packets (X) can contain 0x03 so only treat
+    // it as an interrupt if it is outside of a packet
+    if (interrupt != -1 && (packetStart == -1 || interrupt < packetStart)) {
         return interrupt + 1;
+    } else if (packetStart != -1) {
+        let messageEnd = buffer.indexOf('#', packetStart);
+        return messageEnd == -1 ? -1 : messageEnd + 3;
     } else {
         return -1;
     }
@@ -333,15 +402,21 @@ server.on('connection', function(socket) {
 
     socket.on('end', function() {
         console.log('Debugger connection closed');
-        serialPortPromise.then(serialPort => serialPort.close());
-        serialPortPromise = null;
+        activeSocket = null;
+
+        if (!isStreaming) {
+            serialPortPromise.then(serialPort => serialPort.close());
+            serialPortPromise = null;
+        }
 
         if (controllerOutputFile) {
             fs.close(controllerOutputFile);
             controllerOutputFile = null;
         }
 
-        if (!keepAlive) {
+        flushStreams();
+
+        if (!keepAlive && !isStreaming) {
             server.close();
             process.exit(0);
         }
@@ -0,0 +1,118 @@
+const fs = require('fs');
+const { createDelayedWriter } = require('./delayedwriter');
+
+// OS_CPU_COUNTER, the rate of the cpu counter on a retail console
+const COUNTER_RATE = 46875000;
+const COUNTER_PERIOD = 0x100000000;
+
+const MESSAGE_HEADER = 5;
+const EVENT_SIZE = 4;
+
+const EVENT_BEGIN = 0;
+const EVENT_END = 1;
+const EVENT_COUNTER = 2;
+
+/**
+ * Reads a file with an id and a name on each line so zones and
+ * counters can be named in the trace
+ */
+function readZoneNames(namesPath) {
+    const names = new Map();
+
+    fs.readFileSync(namesPath, 'utf8').split(/\r?\n/).forEach(line => {
+        const match = /^\s*(0x[0-9a-fA-F]+|\d+)\s+(.+?)\s*$/.exec(line);
+
+        if (match) {
+            names.set(Number(match[1]), match[2]);
+        }
+    });
+
+    return names;
+}
+
+/**
+ * Streams GDBDataTypeZones messages to a trace in the Chrome JSON
+ * array format. The closing ] is optional in that format so events
+ * are only ever appended. Each message is the u32 cpu counter and
+ * u64 osGetTime when it was sent, the u32 thread id, a u32 count of
+ * dropped events and events of a u32 time, type, id and value
+ */
+function createZoneTrace(outputPath, namesPath) {
+    const names = namesPath ? readZoneNames(namesPath) : new Map();
+    const file = fs.openSync(outputPath, 'w');
+    const threadIds = new Set();
+    // events waiting for the next write
+    let pending = [];
+    let isFirstEvent = true;
+
+    fs.writeSync(file, '[\n');
+
+    function nameOf(prefix, id) {
+        return names.get(id) || `${prefix} ${id}`;
+    }
+
+    function toMicroseconds(ticks) {
+        return ticks * 1000000 / COUNTER_RATE;
+    }
+
+    function addEvent(event) {
+        pending.push((isFirstEvent ? '' : ',\n') + JSON.stringify(event));
+        isFirstEvent = false;
+    }
+
+    const writer = createDelayedWriter(() => {
+        const text = pending.join('');
+        pending = [];
+        fs.writeSync(file, text);
+    });
+
+    return {
+        addEvents: (data) => {
+            if (data.length < MESSAGE_HEADER * 4) {
+                return;
+            }
+
+            const counter = data.readUInt32BE(0);
+            const now = data.readUInt32BE(4) * COUNTER_PERIOD + data.readUInt32BE(8);
+            const threadId = data.readUInt32BE(12);
+            const dropped = data.readUInt32BE(16);
+
+            if (!threadIds.has(threadId)) {
+                threadIds.add(threadId);
+                addEvent({ name: 'thread_name', ph: 'M', pid: 0, tid: threadId, args: { name: `thread ${threadId.toString(16)}` } });
+            }
+
+            if (dropped) {
+                addEvent({ name: `${dropped} dropped`, ph: 'i', s: 't', ts: toMicroseconds(now), pid: 0, tid: threadId });
+            }
+
+            for (let offset = MESSAGE_HEADER * 4; offset + EVENT_SIZE * 4 <= data.length; offset += EVENT_SIZE * 4) {
+                const time = data.readUInt32BE(offset);
+                const type = data.readUInt32BE(offset + 4);
+                const id = data.readUInt32BE(offset + 8);
+                const value = data.readUInt32BE(offset + 12);
+                // every event is older than the message
+                const ts = toMicroseconds(now - ((counter - time) >>> 0));
+
+                switch (type) {
+                    case EVENT_BEGIN:
+                        addEvent({ name: nameOf('zone', id), ph: 'B', ts, pid: 0, tid: threadId });
+                        break;
+                    case EVENT_END:
+                        addEvent({ ph: 'E', ts, pid: 0, tid: threadId });
+                        break;
+                    case EVENT_COUNTER:
+                        addEvent({ name: nameOf('counter', id), ph: 'C', ts, pid: 0, args: { value } });
+                        break;
+                }
+            }
+
+            writer.schedule();
+        },
+        flush: writer.flush,
+    };
+}
+
+module.exports = {
+    createZoneTrace,
+};